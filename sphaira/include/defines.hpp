@@ -522,7 +522,9 @@ enum class SphairaResult : Result {
 
     AppFailedMusicDownload,
     CurlFailedEasyInit,
+    CurlFailedMultiInit,
     DumpFailedNetworkUpload,
+    DumpBadReadSize,
 
     UnzOpen2_64,
     UnzGetGlobalInfo64,
@@ -532,6 +534,8 @@ enum class SphairaResult : Result {
     UnzOpenCurrentFile,
     UnzGetCurrentFileInfo64,
     UnzReadCurrentFile,
+    UnzStreamUnsupported,
+    UnzStreamBadCrc32,
 
     ZipOpen2_64,
     ZipOpenNewFileInZip,
@@ -669,7 +673,9 @@ enum : Result {
     MAKE_SPHAIRA_RESULT_ENUM(NroBadSize),
     MAKE_SPHAIRA_RESULT_ENUM(AppFailedMusicDownload),
     MAKE_SPHAIRA_RESULT_ENUM(CurlFailedEasyInit),
+    MAKE_SPHAIRA_RESULT_ENUM(CurlFailedMultiInit),
     MAKE_SPHAIRA_RESULT_ENUM(DumpFailedNetworkUpload),
+    MAKE_SPHAIRA_RESULT_ENUM(DumpBadReadSize),
     MAKE_SPHAIRA_RESULT_ENUM(UnzOpen2_64),
     MAKE_SPHAIRA_RESULT_ENUM(UnzGetGlobalInfo64),
     MAKE_SPHAIRA_RESULT_ENUM(UnzLocateFile),
@@ -678,6 +684,8 @@ enum : Result {
     MAKE_SPHAIRA_RESULT_ENUM(UnzOpenCurrentFile),
     MAKE_SPHAIRA_RESULT_ENUM(UnzGetCurrentFileInfo64),
     MAKE_SPHAIRA_RESULT_ENUM(UnzReadCurrentFile),
+    MAKE_SPHAIRA_RESULT_ENUM(UnzStreamUnsupported),
+    MAKE_SPHAIRA_RESULT_ENUM(UnzStreamBadCrc32),
     MAKE_SPHAIRA_RESULT_ENUM(ZipOpen2_64),
     MAKE_SPHAIRA_RESULT_ENUM(ZipOpenNewFileInZip),
     MAKE_SPHAIRA_RESULT_ENUM(ZipWriteInFileInZip),
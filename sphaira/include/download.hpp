@@ -1,6 +1,7 @@
 #pragma once
 
 #include "fs.hpp"
+#include "hasher.hpp"
 #include <vector>
 #include <string>
 #include <functional>
@@ -21,6 +22,12 @@ enum {
 
     // sets CURLOPT_NOBODY.
     Flag_NoBody = 1 << 1,
+
+    // on failure, the partial download is kept and resumed on the next
+    // attempt using a range request, validated by the etag / last-modified.
+    // network errors are retried a few times before giving up.
+    // this api is only available on downloading to file.
+    Flag_Resume = 1 << 2,
 };
 
 enum class Priority {
@@ -36,6 +43,9 @@ using OnComplete = std::function<void(ApiResult& result)>;
 using OnProgress = std::function<bool(s64 dltotal, s64 dlnow, s64 ultotal, s64 ulnow)>;
 using OnUploadCallback = std::function<size_t(void *ptr, size_t size)>;
 using OnUploadSeek = std::function<bool(s64 offset)>;
+// receives the data as it's downloaded, rather than storing it in memory.
+// return false to cancel the download.
+using OnData = std::function<bool(const void* data, s64 size)>;
 using StopToken = std::stop_token;
 
 struct Url {
@@ -117,12 +127,31 @@ struct PrivKey {
     std::string m_str;
 };
 
+// hashes the data as it's received, saves reading it back afterwards.
+// the hash string is stored in ApiResult::hash.
+struct Hash {
+    Hash() = default;
+    Hash(hash::Type type) : m_type{type}, m_enabled{true} {}
+    hash::Type m_type{};
+    bool m_enabled{};
+};
+
+// downloads the file in m_count byte ranges in parallel, if the server supports it.
+// this api is only available on downloading to file, it's ignored with
+// Flag_Cache, Hash or post fields.
+struct Segments {
+    Segments() = default;
+    Segments(u32 count) : m_count{count} {}
+    u32 m_count{};
+};
+
 struct ApiResult {
     bool success;
     long code;
     Header header; // returned headers in request
     std::vector<u8> data; // empty if downloaded a file
     fs::FsPath path; // empty if downloaded memory
+    std::string hash; // empty if no hash was requested
 };
 
 struct DownloadEventData {
@@ -300,8 +329,11 @@ struct Api {
     auto& GetOnComplete() const { return m_on_complete; }
     auto& GetOnProgress() const { return m_on_progress; }
     auto& GetOnUploadSeek() const { return m_on_upload_seek; }
+    auto& GetOnData() const { return m_on_data; }
     auto& GetPriority() const { return m_prio; }
     auto& GetToken() const { return m_stoken; }
+    auto& GetHash() const { return m_hash; }
+    auto& GetSegments() const { return m_segments; }
 
     void SetOption(Url&& v) { m_url = v; }
     void SetOption(Fields&& v) { m_fields = v; }
@@ -318,8 +350,11 @@ struct Api {
     void SetOption(OnComplete&& v) { m_on_complete = v; }
     void SetOption(OnProgress&& v) { m_on_progress = v; }
     void SetOption(OnUploadSeek&& v) { m_on_upload_seek = v; }
+    void SetOption(OnData&& v) { m_on_data = v; }
     void SetOption(Priority&& v) { m_prio = v; }
     void SetOption(StopToken&& v) { m_stoken = v; }
+    void SetOption(Hash&& v) { m_hash = v; }
+    void SetOption(Segments&& v) { m_segments = v; }
 
     template <typename T>
     void set_option(T&& t) {
@@ -348,9 +383,12 @@ private:
     OnComplete m_on_complete{};
     OnProgress m_on_progress{};
     OnUploadSeek m_on_upload_seek{};
+    OnData m_on_data{};
     Priority m_prio{Priority::High};
     std::stop_source m_stop_source{};
     StopToken m_stoken{m_stop_source.get_token()};
+    Hash m_hash{};
+    Segments m_segments{};
     bool m_is_upload{};
 };
 
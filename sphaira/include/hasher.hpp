@@ -22,7 +22,15 @@ struct BaseSource {
     virtual Result Read(void* buf, s64 off, s64 size, u64* bytes_read) = 0;
 };
 
+// incremental hasher, for when the data is already being streamed elsewhere.
+struct HashSource {
+    virtual ~HashSource() = default;
+    virtual void Update(const void* buf, s64 size) = 0;
+    virtual void Get(std::string& out) = 0;
+};
+
 auto GetTypeStr(Type type) -> const char*;
+auto Create(Type type) -> std::unique_ptr<HashSource>;
 
 // returns the hash string.
 Result Hash(ui::ProgressBox* pbox, Type type, BaseSource* source, std::string& out);
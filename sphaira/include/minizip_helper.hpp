@@ -1,8 +1,11 @@
 #pragma once
 
+#include "fs.hpp"
 #include <minizip/ioapi.h>
+#include <zlib.h>
 #include <vector>
 #include <span>
+#include <functional>
 #include <switch.h>
 
 namespace sphaira::mz {
@@ -17,8 +20,134 @@ struct MzSpan {
     size_t offset;
 };
 
+// buffers writes in memory, handing each full buffer to a thread which writes
+// it to the file whilst the next buffer is filled. memory use is fixed at
+// 2 buffers, no matter the size of the zip.
+// seeking back to data that has already been flushed (such as minizip patching
+// a local header) writes directly to the file.
+struct MzFile {
+    MzFile(fs::File* file, s64 flush_size = 1024 * 1024 * 8, u64 write_sleep_ns = 0);
+    ~MzFile();
+
+    // flushes the remaining data and waits for all writes to finish.
+    // returns the first error that happened whilst writing.
+    Result Close();
+
+    auto Tell() const -> s64 {
+        return m_offset;
+    }
+
+    auto Size() const -> s64 {
+        return m_size;
+    }
+
+    auto Seek(s64 offset) -> bool;
+    auto Write(const void* data, s64 size) -> s64;
+
+private:
+    Result Flush();
+    Result WaitForFlush();
+    static void ThreadFunc(void* arg);
+
+private:
+    fs::File* const m_file;
+    const s64 m_flush_size;
+    const u64 m_write_sleep_ns;
+
+    std::vector<u8> m_buf{};
+    // file offset of the start of m_buf.
+    s64 m_buf_offset{};
+    s64 m_offset{};
+    s64 m_size{};
+
+    Thread m_thread{};
+    Mutex m_mutex{};
+    CondVar m_can_flush{};
+    CondVar m_flushed{};
+
+    // shared with the thread.
+    std::vector<u8> m_flush_buf{};
+    s64 m_flush_offset{};
+    Result m_result{};
+    bool m_flush_pending{};
+    bool m_quit{};
+    bool m_thread_started{};
+};
+
 void FileFuncMem(MzMem* mem, zlib_filefunc64_def* funcs);
 void FileFuncSpan(MzSpan* span, zlib_filefunc64_def* funcs);
 void FileFuncStdio(zlib_filefunc64_def* funcs);
+void FileFuncFile(MzFile* file, zlib_filefunc64_def* funcs);
+
+// extracts a zip as it's being received, using only the local file headers.
+// this allows for a zip to be extracted whilst it's still downloading.
+// zips that cannot be streamed (encrypted, unknown compression or stored entries
+// with a data descriptor) return Result_UnzStreamUnsupported, the caller should
+// then fallback to extracting using the central directory.
+struct StreamUnzip {
+    struct Entry {
+        fs::FsPath name;
+        u32 crc32;
+        s64 compressed_size; // 0 until the entry ends if it has a data descriptor.
+        s64 uncompressed_size; // same as above.
+    };
+
+    // set path to where the entry should be extracted, leave it empty to skip the entry.
+    using OnEntry = std::function<Result(const Entry& entry, fs::FsPath& path)>;
+    // called once the entry has been extracted and its crc32 has been validated.
+    using OnEntryDone = std::function<Result(const Entry& entry, const fs::FsPath& path)>;
+
+    StreamUnzip(fs::Fs* fs, const OnEntry& on_entry, const OnEntryDone& on_done = nullptr);
+    ~StreamUnzip();
+
+    // feeds the next chunk of the zip.
+    Result Push(const void* data, s64 size);
+    // call once all data has been pushed, fails if the zip ended part way through an entry.
+    Result Finish();
+
+private:
+    enum class State {
+        Header,
+        Data,
+        Descriptor,
+        Done,
+    };
+
+    Result ParseHeader();
+    Result ParseDescriptor();
+    Result BeginEntry();
+    Result EndData();
+    Result EndEntry();
+    Result PushData(const u8* data, s64 size, s64* used);
+    Result WriteOut(const u8* data, s64 size);
+    Result FlushOut();
+
+private:
+    fs::Fs* m_fs;
+    OnEntry m_on_entry;
+    OnEntryDone m_on_done;
+    State m_state{State::Header};
+
+    // header / descriptor bytes collected so far.
+    std::vector<u8> m_header{};
+    u64 m_header_want{4};
+
+    Entry m_entry{};
+    u16 m_flags{};
+    u16 m_method{};
+    bool m_zip64{};
+    // compressed bytes left in the entry, only valid without a data descriptor.
+    s64 m_data_left{};
+
+    z_stream m_z{};
+    bool m_z_init{};
+
+    fs::FsPath m_path{};
+    fs::File m_file{};
+    std::vector<u8> m_out{};
+    s64 m_out_offset{};
+    s64 m_file_offset{};
+    u32 m_crc32{};
+};
 
 } // namespace sphaira::mz
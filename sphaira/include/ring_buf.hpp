@@ -0,0 +1,145 @@
+#pragma once
+
+#include "defines.hpp"
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <switch.h>
+
+namespace sphaira {
+
+// single producer, single consumer ring buffer.
+// push / pop only use atomics, the caller only blocks (on an event) when the
+// ring is full / empty, the other side signals the event once it makes progress.
+template<typename T, std::size_t Size>
+struct RingBuf {
+    static_assert(Size && (Size & (Size - 1)) == 0, "Must be power of 2!");
+
+    RingBuf() {
+        ueventCreate(std::addressof(m_can_push), true);
+        ueventCreate(std::addressof(m_can_pop), true);
+    }
+
+    static constexpr auto Capacity() -> std::size_t {
+        return Size;
+    }
+
+    // limits the number of entries in flight, clamped to [1, Size] and rounded
+    // down to a power of 2. only the first depth entries are used, so unused
+    // entries never hold onto memory.
+    // must be set before either side starts using the ring.
+    void SetDepth(std::size_t depth) {
+        m_depth = std::bit_floor(std::clamp<std::size_t>(depth, 1, Size));
+    }
+
+    auto GetDepth() const -> std::size_t {
+        return m_depth;
+    }
+
+    auto GetSize() const -> std::size_t {
+        return m_w_index.load() - m_r_index.load();
+    }
+
+    auto IsEmpty() const -> bool {
+        return !GetSize();
+    }
+
+    auto IsFull() const -> bool {
+        return GetSize() >= m_depth;
+    }
+
+    // calls fill(T&) on a free entry, returns false if the ring is full.
+    template<typename F>
+    auto TryPush(F&& fill) -> bool {
+        const auto w = m_w_index.load(std::memory_order_relaxed);
+        if (w - m_r_index.load() >= m_depth) {
+            return false;
+        }
+
+        fill(m_buf[w % m_depth]);
+        m_w_index.store(w + 1);
+
+        if (m_pop_waiting.load()) {
+            ueventSignal(std::addressof(m_can_pop));
+        }
+
+        return true;
+    }
+
+    // calls drain(T&) on the oldest entry, returns false if the ring is empty.
+    template<typename F>
+    auto TryPop(F&& drain) -> bool {
+        const auto r = m_r_index.load(std::memory_order_relaxed);
+        if (m_w_index.load() == r) {
+            return false;
+        }
+
+        drain(m_buf[r % m_depth]);
+        m_r_index.store(r + 1);
+
+        if (m_push_waiting.load()) {
+            ueventSignal(std::addressof(m_can_push));
+        }
+
+        return true;
+    }
+
+    // same as TryPush(), but blocks until there's a free entry.
+    // check() is called before blocking, returning an error stops the wait.
+    template<typename F, typename C>
+    Result Push(F&& fill, C&& check) {
+        while (!TryPush(fill)) {
+            R_TRY(check());
+
+            m_push_waiting.store(true);
+            if (IsFull()) {
+                waitSingle(waiterForUEvent(std::addressof(m_can_push)), UINT64_MAX);
+            }
+            m_push_waiting.store(false);
+        }
+
+        R_SUCCEED();
+    }
+
+    // same as TryPop(), but blocks until there's an entry.
+    // check() is called before blocking, returning an error stops the wait.
+    template<typename F, typename C>
+    Result Pop(F&& drain, C&& check) {
+        while (!TryPop(drain)) {
+            R_TRY(check());
+
+            m_pop_waiting.store(true);
+            if (IsEmpty()) {
+                waitSingle(waiterForUEvent(std::addressof(m_can_pop)), UINT64_MAX);
+            }
+            m_pop_waiting.store(false);
+        }
+
+        R_SUCCEED();
+    }
+
+    // wakes up both sides, used to break out of Push() / Pop() on error.
+    void WakeAll() {
+        ueventSignal(std::addressof(m_can_push));
+        ueventSignal(std::addressof(m_can_pop));
+    }
+
+private:
+    T m_buf[Size]{};
+    std::size_t m_depth{Size};
+
+    // free running indices, wrapping is fine as the depth is a power of 2.
+    std::atomic<std::size_t> m_r_index{};
+    std::atomic<std::size_t> m_w_index{};
+
+    // set whilst a side is (about to be) blocked, so the other side
+    // only signals the event when it's needed.
+    std::atomic_bool m_push_waiting{};
+    std::atomic_bool m_pop_waiting{};
+
+    UEvent m_can_push{};
+    UEvent m_can_pop{};
+};
+
+} // namespace sphaira
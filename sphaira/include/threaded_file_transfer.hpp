@@ -2,6 +2,7 @@
 
 #include "ui/progress_box.hpp"
 #include <functional>
+#include <minizip/zip.h>
 #include <switch.h>
 
 namespace sphaira::thread {
@@ -15,6 +16,29 @@ enum class Mode {
     SingleThreadedIfSmaller,
 };
 
+// max number of buffers that can be in flight between the read and write thread.
+constexpr u32 MAX_QUEUE_DEPTH = 8;
+
+// controls the queue depth and chunk size of a transfer.
+struct Policy {
+    // number of buffers in flight, rounded down to a power of 2, max of MAX_QUEUE_DEPTH.
+    // capped to 2 in applet mode.
+    u32 depth{2};
+    // size of each read, 0 uses the default size of the transfer.
+    u64 chunk_size{};
+    // grows / shrinks the chunk size (between min and max) based on the
+    // measured read and write latency of each chunk.
+    bool adaptive{};
+    u64 min_chunk_size{1024*256};
+    u64 max_chunk_size{1024*1024*4};
+};
+
+// double buffered, fixed chunk size.
+constexpr Policy POLICY_DEFAULT{};
+// for sources with bursty latency, such as network, usb and gamecard.
+// more buffers in flight keeps the writer busy whilst the reader stalls.
+constexpr Policy POLICY_BURSTY{ .depth = 8, .adaptive = true };
+
 using ReadCallback = std::function<Result(void* data, s64 off, s64 size, u64* bytes_read)>;
 using WriteCallback = std::function<Result(const void* data, s64 off, s64 size)>;
 
@@ -32,25 +56,32 @@ using StartCallback = std::function<Result(PullCallback pull)>;
 using StartCallback2 = std::function<Result(StartThreadCallback start, PullCallback pull)>;
 
 // reads data from rfunc into wfunc.
-Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, Mode mode = Mode::MultiThreaded);
+Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, Mode mode = Mode::MultiThreaded, const Policy& policy = POLICY_DEFAULT);
 
 // reads data from rfunc, pull data from provided pull() callback.
-Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback sfunc, Mode mode = Mode::MultiThreaded);
-Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback2 sfunc, Mode mode = Mode::MultiThreaded);
+Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback sfunc, Mode mode = Mode::MultiThreaded, const Policy& policy = POLICY_DEFAULT);
+Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback2 sfunc, Mode mode = Mode::MultiThreaded, const Policy& policy = POLICY_DEFAULT);
 
 // helper for extract zips.
 // this will multi-thread unzip if size >= 512KiB, otherwise it'll single pass.
-Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32 = 0, Mode mode = Mode::SingleThreadedIfSmaller);
+Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32 = 0, Mode mode = Mode::SingleThreadedIfSmaller, const Policy& policy = POLICY_DEFAULT);
 
 // same as above but for zipping files.
-Result TransferZip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, u32* crc32 = nullptr, Mode mode = Mode::SingleThreadedIfSmaller);
+Result TransferZip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, u32* crc32 = nullptr, Mode mode = Mode::SingleThreadedIfSmaller, const Policy& policy = POLICY_DEFAULT);
+
+// adds a new file to the zip and compresses path into it.
+// large files are split into chunks which are deflated on multiple cores (like pigz),
+// each chunk using the end of the previous chunk as its dictionary.
+Result TransferZipFile(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, const char* name_in_zip, const zip_fileinfo* info, int level, Mode mode = Mode::SingleThreadedIfSmaller, const Policy& policy = POLICY_DEFAULT);
 
 // passes the name inside the zip an final output path.
 using UnzipAllFilter = std::function<bool(const fs::FsPath& name, fs::FsPath& path)>;
 
 // helper all-in-one unzip function that unzips a zip (either open or path provided).
 // the filter function can be used to modify the path and filter out unwanted files.
-Result TransferUnzipAll(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter = nullptr, Mode mode = Mode::SingleThreadedIfSmaller);
-Result TransferUnzipAll(ui::ProgressBox* pbox, const fs::FsPath& zip_out, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter = nullptr, Mode mode = Mode::SingleThreadedIfSmaller);
+Result TransferUnzipAll(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter = nullptr, Mode mode = Mode::SingleThreadedIfSmaller, const Policy& policy = POLICY_DEFAULT);
+// when given a path, small files are extracted in parallel using a handle per thread,
+// unless mode is Mode::SingleThreaded.
+Result TransferUnzipAll(ui::ProgressBox* pbox, const fs::FsPath& zip_out, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter = nullptr, Mode mode = Mode::SingleThreadedIfSmaller, const Policy& policy = POLICY_DEFAULT);
 
 } // namespace sphaira::thread
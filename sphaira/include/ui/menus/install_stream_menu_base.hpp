@@ -26,15 +26,25 @@ struct Stream final : yati::source::Stream {
     Stream(const fs::FsPath& path, std::stop_token token);
 
     Result ReadChunk(void* buf, s64 size, u64* bytes_read) override;
+    Result SkipChunk(s64 size, u64* bytes_skipped) override;
     bool Push(const void* buf, s64 size);
     void Disable();
     auto& GetPath() const { return m_path; }
 
+private:
+    // buf may be null, in which case the data is discarded.
+    Result Pop(void* buf, s64 size, u64* bytes_read);
+    void Grow(s64 size);
+
 private:
     fs::FsPath m_path{};
     std::stop_token m_token{};
+    // circular buffer, only grows if the writer is forced to push whilst full.
     std::vector<u8> m_buffer{};
+    s64 m_read_offset{};
+    s64 m_size{};
     CondVar m_can_read{};
+    CondVar m_can_write{};
 
 public:
     Mutex m_mutex{};
@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <new>
+#include <functional>
 #include <switch.h>
 
 namespace sphaira::usb {
@@ -29,6 +30,25 @@ struct Base {
         return TransferAll(read, data, size, m_transfer_timeout);
     }
 
+    // fill the buffer with size bytes of data starting at off.
+    using FillCallback = std::function<Result(void* buf, s64 off, s64 size)>;
+    // consume size bytes of data starting at off.
+    using DrainCallback = std::function<Result(const void* buf, s64 off, s64 size)>;
+
+    // transfers all data in chunks, double buffered using aligned buffers
+    // owned by usb. the next chunk is filled (or the previous chunk drained)
+    // whilst the current chunk is in flight, which lets the caller read / write
+    // the data in place, without an extra copy.
+    Result TransferAllWrite(s64 size, const FillCallback& fill, u64 timeout);
+    Result TransferAllWrite(s64 size, const FillCallback& fill) {
+        return TransferAllWrite(size, fill, m_transfer_timeout);
+    }
+
+    Result TransferAllRead(s64 size, const DrainCallback& drain, u64 timeout);
+    Result TransferAllRead(s64 size, const DrainCallback& drain) {
+        return TransferAllRead(size, drain, m_transfer_timeout);
+    }
+
     // returns the cancel event.
     auto GetCancelEvent() {
         return &m_uevent;
@@ -87,10 +107,17 @@ protected:
     virtual Result TransferAsync(UsbSessionEndpoint ep, void *buffer, u32 remaining, u32 size, u32 *out_xfer_id) = 0;
     virtual Result GetTransferResult(UsbSessionEndpoint ep, u32 xfer_id, u32 *out_requested_size, u32 *out_transferred_size) = 0;
 
+private:
+    // starts a transfer / waits for a started transfer to complete.
+    Result TransferPacketBegin(bool read, void *page, u32 remaining, u32 size, u32 *out_xfer_id, u64 timeout);
+    Result TransferPacketEnd(bool read, u32 xfer_id, u32 *out_size_transferred, u64 timeout);
+
 private:
     u64 m_transfer_timeout{};
     UEvent m_uevent{};
     PageAlignedVector m_aligned{};
+    // buffers used by TransferAllWrite() and TransferAllRead().
+    PageAlignedVector m_chunks[2]{};
 };
 
 } // namespace sphaira::usb
@@ -5,6 +5,7 @@
 #include <string>
 #include <memory>
 #include <span>
+#include <vector>
 #include <switch.h>
 
 namespace sphaira::usb::upload {
@@ -15,6 +16,12 @@ struct Usb {
 
     virtual Result Read(const std::string& path, void* buf, s64 off, s64 size, u64* bytes_read) = 0;
 
+    // returns the size of the file, used to prefetch the next range.
+    // returning 0 disables prefetching.
+    virtual auto GetFileSize(const std::string& path) -> s64 {
+        return 0;
+    }
+
     Result IsUsbConnected(u64 timeout) {
         return m_usb->IsUsbConnected(timeout);
     }
@@ -26,11 +33,30 @@ struct Usb {
     // will return Result_Exit if exit command is recieved.
     Result PollCommands();
 
+    // waits for the prefetch to finish, as it calls Read(), this must be
+    // called by the derived destructor.
+    void WaitForPrefetch();
+
 private:
     Result FileRangeCmd(u64 data_size);
+    void StartPrefetch(const std::string& path, s64 off, s64 size);
 
 private:
+    struct Range {
+        std::string path{};
+        s64 offset{};
+        std::vector<u8> data{};
+    };
+
     std::unique_ptr<usb::UsbHs> m_usb;
+
+    // data that was read ahead of the host requesting it.
+    Range m_cache{};
+    // range being read in the background whilst the previous one is sent.
+    Range m_prefetch{};
+    Result m_prefetch_rc{};
+    Thread m_prefetch_thread{};
+    bool m_prefetch_pending{};
 };
 
 } // namespace sphaira::usb::upload
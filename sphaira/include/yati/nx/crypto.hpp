@@ -1,6 +1,8 @@
 #pragma once
 
 #include <switch.h>
+#include <bit>
+#include <cstring>
 
 namespace sphaira::crypto {
 
@@ -31,13 +33,10 @@ struct Aes128Xts {
     }
 
     void Run(void *dst, const void *src, u64 sector, u64 sector_size, u64 data_size) {
+        const auto func = m_is_encryptor ? aes128XtsEncrypt : aes128XtsDecrypt;
         for (u64 pos = 0; pos < data_size; pos += sector_size) {
             aes128XtsContextResetSector(&m_ctx, sector++, true);
-            if (m_is_encryptor) {
-                aes128XtsEncrypt(&m_ctx, static_cast<u8*>(dst) + pos, static_cast<const u8*>(src) + pos, sector_size);
-            } else {
-                aes128XtsDecrypt(&m_ctx, static_cast<u8*>(dst) + pos, static_cast<const u8*>(src) + pos, sector_size);
-            }
+            func(&m_ctx, static_cast<u8*>(dst) + pos, static_cast<const u8*>(src) + pos, sector_size);
         }
     }
 
@@ -46,6 +45,78 @@ private:
     bool m_is_encryptor;
 };
 
+// nca style ctr, the upper half of the counter is the section ctr and the
+// lower half is the (big endian) block offset, so a context can be created
+// at any offset.
+struct Aes128Ctr {
+    Aes128Ctr(const void *key, const void *ctr, u64 offset) {
+        const auto swp = std::byteswap(offset >> 4);
+        u8 counter[0x10];
+        std::memcpy(counter + 0x0, ctr, 0x8);
+        std::memcpy(counter + 0x8, &swp, 0x8);
+        aes128CtrContextCreate(&m_ctx, key, counter);
+
+        // skip into the block if the offset isn't aligned.
+        if (const auto skip = offset & 0xF) {
+            u8 temp[0x10]{};
+            aes128CtrCrypt(&m_ctx, temp, temp, skip);
+        }
+    }
+
+    void Run(void *dst, const void *src, u64 size) {
+        aes128CtrCrypt(&m_ctx, dst, src, size);
+    }
+
+private:
+    Aes128CtrContext m_ctx;
+};
+
+// splits large ctr spans between the calling thread and a few workers,
+// each part uses its own context created at the offset of that part.
+struct Aes128CtrPool {
+    static constexpr u32 MAX_THREADS = 2;
+
+    Aes128CtrPool();
+    ~Aes128CtrPool();
+
+    Result Create();
+    void Close();
+
+    auto IsCreated() const -> bool {
+        return m_thread_count;
+    }
+
+    // crypts buf in place, offset is the offset of buf within the section.
+    // falls back to the calling thread if the pool hasn't been created.
+    void Run(const void *key, const void *ctr, u64 offset, void *buf, u64 size);
+
+private:
+    struct Job {
+        const void* key{};
+        const void* ctr{};
+        u64 offset{};
+        u8* buf{};
+        u64 size{};
+        bool pending{};
+    };
+
+    struct Worker {
+        Aes128CtrPool* pool{};
+        Job job{};
+        Thread thread{};
+    };
+
+    static void WorkerFunc(void* d);
+
+private:
+    Mutex m_mutex{};
+    CondVar m_can_work{};
+    CondVar m_done{};
+    Worker m_workers[MAX_THREADS]{};
+    u32 m_thread_count{};
+    bool m_quit{};
+};
+
 static inline void cryptoAes128(const void *in, void *out, const void* key, bool is_encryptor) {
     Aes128(key, is_encryptor).Run(out, in);
 }
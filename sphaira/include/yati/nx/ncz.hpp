@@ -1,6 +1,10 @@
 #pragma once
 
 #include <switch.h>
+#include <span>
+#include <memory>
+#include <iterator>
+#include <algorithm>
 
 namespace sphaira::ncz {
 
@@ -51,4 +55,29 @@ struct Section {
     }
 };
 
+// finds the entry which contains the offset, entries must be sorted by offset.
+// the hint (usually the last found entry) and the entry after it are checked first
+// as lookups almost always move forward, otherwise falls back to a binary search.
+template<typename T>
+auto FindInRange(std::span<const T> entries, u64 off, const T* hint = nullptr) -> const T* {
+    if (hint) {
+        if (hint->InRange(off)) {
+            return hint;
+        }
+
+        const auto next = hint + 1;
+        if (next < entries.data() + entries.size() && next->InRange(off)) {
+            return next;
+        }
+    }
+
+    // find the first entry past the offset, the entry before it is the only candidate.
+    const auto it = std::ranges::upper_bound(entries, off, std::ranges::less{}, &T::offset);
+    if (it == entries.begin() || !std::prev(it)->InRange(off)) {
+        return nullptr;
+    }
+
+    return std::addressof(*std::prev(it));
+}
+
 } // namespace sphaira::ncz
@@ -14,10 +14,21 @@ struct Base {
         return false;
     }
 
+    // returns true if Read() can be called from multiple threads at once.
+    virtual bool IsConcurrent() const {
+        return false;
+    }
+
     virtual void SignalCancel() {
 
     }
 
+    // hints that [off, off + size) is about to be read sequentially, which
+    // sources can use to read ahead. a size of 0 clears the hint.
+    virtual void SetReadAheadRange(s64 off, s64 size) {
+
+    }
+
     Result GetOpenResult() const {
         return m_open_result;
     }
@@ -9,8 +9,12 @@ namespace sphaira::yati::source {
 // streams are for data that do not allow for random access,
 // such as FTP or MTP.
 struct Stream : Base {
-    virtual ~Stream() = default;
+    virtual ~Stream();
     virtual Result ReadChunk(void* buf, s64 size, u64* bytes_read) = 0;
+    // discards up to size bytes, used when seeking forwards.
+    // the default reads into a small scratch buffer, override if the
+    // transport can skip without reading the data.
+    virtual Result SkipChunk(s64 size, u64* bytes_skipped);
 
     Result Read(void* buf, s64 off, s64 size, u64* bytes_read) override;
 
@@ -22,11 +26,22 @@ struct Stream : Base {
         m_offset = 0;
     }
 
+    auto GetSkippedSize() const {
+        return m_skipped_size;
+    }
+
+    auto GetSkipCount() const {
+        return m_skip_count;
+    }
+
 protected:
     Result m_open_result{};
 
 private:
     s64 m_offset{};
+    std::vector<u8> m_skip_buf{};
+    s64 m_skipped_size{};
+    u32 m_skip_count{};
 };
 
 } // namespace sphaira::yati::source
@@ -12,6 +12,7 @@ namespace sphaira::yati::source {
 struct StreamFile final : Stream {
     StreamFile(fs::Fs* fs, const fs::FsPath& path);
     Result ReadChunk(void* buf, s64 size, u64* bytes_read) override;
+    Result SkipChunk(s64 size, u64* bytes_skipped) override;
 
 private:
     fs::Fs* m_fs{};
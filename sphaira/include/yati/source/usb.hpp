@@ -5,6 +5,7 @@
 #include "usb/usbds.hpp"
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <switch.h>
 
@@ -29,14 +30,27 @@ struct Usb final : Base {
         m_usb->Cancel();
     }
 
+    void SetReadAheadRange(s64 off, s64 size) override {
+        m_read_ahead_offset = off;
+        m_read_ahead_end = off + size;
+    }
+
 private:
     Result SendCmdHeader(u32 cmdId, size_t dataSize, u64 timeout);
     Result SendFileRangeCmd(u64 offset, u64 size, u64 timeout);
+    Result ReadRange(void* buf, s64 off, s64 size);
 
 private:
     std::unique_ptr<usb::UsbDs> m_usb;
     std::string m_transfer_file_name{};
     u8 m_flags{};
+
+    // range that will be read sequentially, set by SetReadAheadRange().
+    s64 m_read_ahead_offset{};
+    s64 m_read_ahead_end{};
+    // data that was read ahead, starting at m_cache_offset.
+    std::vector<u8> m_cache{};
+    s64 m_cache_offset{};
 };
 
 } // namespace sphaira::yati::source
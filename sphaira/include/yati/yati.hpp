@@ -78,6 +78,18 @@ struct ConfigOverride {
     std::optional<bool> lower_system_version{};
 };
 
+// whilst alive, installs share a cache of the installed content meta
+// rather than listing it from the ncm db each time.
+// create one around a batch of installs, nothing else may modify the
+// installed content whilst it's alive.
+struct Session {
+    Session();
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+};
+
 Result InstallFromFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, const ConfigOverride& override = {});
 Result InstallFromSource(ui::ProgressBox* pbox, source::Base* source, const fs::FsPath& path, const ConfigOverride& override = {});
 Result InstallFromContainer(ui::ProgressBox* pbox, container::Base* container, const ConfigOverride& override = {});
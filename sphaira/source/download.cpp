@@ -29,11 +29,38 @@ namespace {
         log_write("curl_share_setopt(%s, %s) msg: %s\n", #opt, #v, curl_share_strerror(r)); \
     } \
 
+#define CURL_MULTI_SETOPT_LOG(handle, opt, v) \
+    if (auto r = curl_multi_setopt(handle, opt, v); r != CURLM_OK) { \
+        log_write("curl_multi_setopt(%s, %s) msg: %s\n", #opt, #v, curl_multi_strerror(r)); \
+    } \
+
 constexpr auto API_AGENT = "TotalJustice";
 constexpr u64 CHUNK_SIZE = 1024*1024;
-constexpr auto MAX_THREADS = 4;
+// max size to preallocate from the content-length, in case it's bogus.
+constexpr s64 MEMORY_MAX_PREALLOC = 1024*1024*64;
+// max amount a memory download grows by at once, above this the buffer
+// grows linearly so that the peak during a realloc stays close to 2x.
+constexpr u64 MEMORY_MAX_GROW = 1024*1024*32;
+// max number of async transfers in flight on the multi handle.
+constexpr u32 MULTI_MAX_TRANSFERS = 32;
+// number of the above that only high priority transfers can use.
+constexpr u32 MULTI_HIGH_PRIO_RESERVED = 8;
+// transfers over this limit wait inside curl for a connection to be free.
+constexpr long MULTI_MAX_HOST_CONNECTIONS = 8;
+// max number of idle connections kept alive for reuse.
+constexpr long CONNECTION_POOL_SIZE = 16;
+// idle connections older than this (seconds) are closed rather than reused.
+constexpr long CONNECTION_MAX_IDLE = 60 * 2;
+// how long (seconds) resolved hosts are cached for, the default is 60.
+constexpr long DNS_CACHE_TIMEOUT = 60 * 10;
+
 constexpr int THREAD_PRIO = PRIO_PREEMPTIVE;
 constexpr int THREAD_CORE = 1;
+// number of times a resumable download is retried after a network error.
+constexpr u32 RESUME_MAX_RETRIES = 3;
+// files smaller than this are not worth splitting into segments.
+constexpr s64 SEGMENTED_MIN_SIZE = 1024*1024*8;
+constexpr u32 SEGMENTED_MAX_COUNT = 8;
 
 std::atomic_bool g_running{};
 CURLSH* g_curl_share{};
@@ -54,6 +81,58 @@ struct DataStruct {
     s64 offset{};
     fs::File f{};
     s64 file_offset{};
+    std::unique_ptr<hash::HashSource> hash{}; // optional, updated as data arrives.
+    hash::Type hash_type{};
+    const OnData* on_data{}; // optional, receives the data rather than storing it.
+    // used to query the response in the write callbacks.
+    CURL* curl{};
+    // set when resuming, the response code is checked on the first write.
+    bool check_range{};
+};
+
+struct SegmentedDownload;
+
+struct Segment {
+    SegmentedDownload* parent{};
+    CURL* curl{};
+    std::string range{};
+    s64 offset{};
+    s64 size{};
+    s64 written{};
+    bool checked{};
+};
+
+struct SegmentedDownload {
+    const Api* api{};
+    fs::File file{};
+    s64 size{};
+    std::vector<Segment> segments{};
+};
+
+// state of a single download, split from the perform so that it can be
+// driven by either curl_easy_perform() or the multi handle.
+// curl keeps pointers into this, so it must not move once setup.
+struct DownloadState {
+    DownloadState() = default;
+    DownloadState(const DownloadState&) = delete;
+    DownloadState& operator=(const DownloadState&) = delete;
+
+    ~DownloadState() {
+        if (list) {
+            curl_slist_free_all(list);
+        }
+    }
+
+    std::string encoded_url{};
+    DataStruct chunk{};
+    Header header_in{};
+    Header header_out{};
+    struct curl_slist* list{};
+    fs::FsNativeSd fs{};
+    fs::FsPath tmp_buf{};
+    bool has_file{};
+    bool has_post{};
+    bool resume{};
 };
 
 struct SeekCustomData {
@@ -130,6 +209,20 @@ struct Cache {
         }
     }
 
+    // returns the value used for if-range, the etag is preferred, however
+    // weak etags are not allowed for if-range.
+    auto get_validator(const fs::FsPath& path) -> std::string {
+        mutexLock(&m_mutex);
+        ON_SCOPE_EXIT(mutexUnlock(&m_mutex));
+
+        const auto [etag, last_modified] = get_internal(path);
+        if (!etag.empty() && !etag.starts_with("W/")) {
+            return etag;
+        }
+
+        return last_modified;
+    }
+
     void set(const fs::FsPath& path, const curl::Header& value) {
         mutexLock(&m_mutex);
         ON_SCOPE_EXIT(mutexUnlock(&m_mutex));
@@ -307,28 +400,63 @@ struct ThreadEntry {
     UEvent m_uevent{};
 };
 
-struct ThreadQueueEntry {
-    Api api;
-    bool m_delete{};
+// a transfer in flight on the multi handle.
+struct MultiTransfer {
+    Api api{};
+    CURL* curl{};
+    DownloadState state{};
 };
 
+// drives all async transfers from a single thread using the multi interface.
+// transfers that block (uploads, resume, segmented) are passed to the worker.
 struct ThreadQueue {
-    std::deque<ThreadQueueEntry> m_entries;
+    std::deque<Api> m_entries;
     Thread m_thread;
     Mutex m_mutex{};
-    UEvent m_uevent{};
+    CURLM* m_multi{};
+
+    // only accessed by the thread.
+    std::vector<std::unique_ptr<MultiTransfer>> m_transfers{};
+    // free easy handles, reused rather than created for each transfer.
+    std::vector<CURL*> m_handles{};
 
     auto Create() -> Result {
-        ueventCreate(&m_uevent, true);
+        m_multi = curl_multi_init();
+        R_UNLESS(m_multi != nullptr, Result_CurlFailedMultiInit);
+        CURL_MULTI_SETOPT_LOG(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, MULTI_MAX_HOST_CONNECTIONS);
+        CURL_MULTI_SETOPT_LOG(m_multi, CURLMOPT_MAXCONNECTS, CONNECTION_POOL_SIZE);
+
         R_TRY(threadCreate(&m_thread, ThreadFunc, this, nullptr, 1024*32, THREAD_PRIO, THREAD_CORE));
         R_TRY(threadStart(&m_thread));
         R_SUCCEED();
     }
 
     void Close() {
-        ueventSignal(&m_uevent);
+        Wakeup();
         threadWaitForExit(&m_thread);
         threadClose(&m_thread);
+
+        for (auto& transfer : m_transfers) {
+            curl_multi_remove_handle(m_multi, transfer->curl);
+            curl_easy_cleanup(transfer->curl);
+        }
+        m_transfers.clear();
+
+        for (auto curl : m_handles) {
+            curl_easy_cleanup(curl);
+        }
+        m_handles.clear();
+
+        if (m_multi) {
+            curl_multi_cleanup(m_multi);
+            m_multi = nullptr;
+        }
+    }
+
+    void Wakeup() {
+        if (m_multi) {
+            curl_multi_wakeup(m_multi);
+        }
     }
 
     auto Add(const Api& api, bool is_upload = false) -> bool {
@@ -341,21 +469,28 @@ struct ThreadQueue {
 
         switch (api.GetPriority()) {
             case Priority::Normal:
-                m_entries.emplace_back(api).api.SetUpload(is_upload);
+                m_entries.emplace_back(api).SetUpload(is_upload);
                 break;
             case Priority::High:
-                m_entries.emplace_front(api).api.SetUpload(is_upload);
+                m_entries.emplace_front(api).SetUpload(is_upload);
                 break;
         }
 
-        ueventSignal(&m_uevent);
+        Wakeup();
         return true;
     }
 
+    // starts as many queued transfers as there are free slots.
+    void StartTransfers();
+    // removes finished / cancelled transfers, pushing the result.
+    void FinishTransfers();
+    void FinishTransfer(std::unique_ptr<MultiTransfer>& transfer, CURLcode res);
+
     static void ThreadFunc(void* p);
 };
 
-ThreadEntry g_threads[MAX_THREADS]{};
+// runs the transfers that block.
+ThreadEntry g_worker{};
 ThreadQueue g_thread_queue;
 Cache g_cache;
 
@@ -371,6 +506,31 @@ void GetDownloadTempPath(fs::FsPath& buf) {
     std::snprintf(buf, sizeof(buf), "/switch/sphaira/cache/download_temp%lu", count_copy);
 }
 
+// the path is based on the dst path so that the partial download is found
+// again on the next attempt.
+void GetDownloadResumePath(const fs::FsPath& path, fs::FsPath& buf) {
+    std::snprintf(buf, sizeof(buf), "/switch/sphaira/cache/download_resume%s", generate_key_from_path(path).c_str());
+}
+
+// the url of the partial download is stored next to it, as several
+// downloads share the same dst path (such as the appstore temp.zip).
+void GetDownloadResumeUrlPath(const fs::FsPath& path, fs::FsPath& buf) {
+    std::snprintf(buf, sizeof(buf), "%s.url", path.s);
+}
+
+// only network errors are worth retrying, not a cancel or a failed setup.
+auto IsTransientError(CURLcode res) -> bool {
+    switch (res) {
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_RECV_ERROR:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_OPERATION_TIMEDOUT:
+            return true;
+        default:
+            return false;
+    }
+}
+
 auto ProgressCallbackFunc1(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) -> size_t {
     if (!g_running) {
         return 1;
@@ -395,6 +555,28 @@ auto ProgressCallbackFunc2(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
     return 0;
 }
 
+auto ProgressCallbackSegment(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) -> size_t {
+    auto segment = static_cast<Segment*>(clientp);
+    auto parent = segment->parent;
+    if (!g_running || parent->api->GetToken().stop_requested()) {
+        return 1;
+    }
+
+    // report the progress of all segments combined.
+    if (parent->api->GetOnProgress()) {
+        s64 written{};
+        for (const auto& e : parent->segments) {
+            written += e.written;
+        }
+
+        if (!parent->api->GetOnProgress()(parent->size, written, 0, 0)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 auto SeekCallback(void *clientp, curl_off_t offset, int origin) -> int {
     if (!g_running) {
         return 0;
@@ -491,15 +673,54 @@ auto WriteMemoryCallback(void *contents, size_t size, size_t num_files, void *us
     auto data_struct = static_cast<DataStruct*>(userp);
     const auto realsize = size * num_files;
 
-    // give it more memory
-    if (data_struct->data.capacity() < data_struct->offset + realsize) {
-        data_struct->data.reserve(data_struct->data.capacity() + CHUNK_SIZE);
+    // size the buffer from the content-length on the first write, so that
+    // it's never reallocated. the content-length is of the encoded data if
+    // compression is used, so it may still need to grow.
+    if (!data_struct->offset && data_struct->curl) {
+        curl_off_t length = -1;
+        if (curl_easy_getinfo(data_struct->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK && length > 0) {
+            data_struct->data.reserve(std::min<s64>(length, MEMORY_MAX_PREALLOC));
+        }
+    }
+
+    // otherwise, grow by 1.5x rather than a fixed chunk, which would copy
+    // the data many times over for large downloads, capped to MEMORY_MAX_GROW.
+    const auto new_size = data_struct->offset + realsize;
+    if (data_struct->data.capacity() < new_size) {
+        const auto capacity = data_struct->data.capacity();
+        const auto grow = std::min<size_t>(capacity / 2, MEMORY_MAX_GROW);
+        data_struct->data.reserve(std::max<size_t>({new_size, capacity + grow, CHUNK_SIZE}));
     }
 
-    data_struct->data.resize(data_struct->offset + realsize);
-    std::memcpy(data_struct->data.data() + data_struct->offset, contents, realsize);
+    // insert rather than resize, which would zero the memory before the copy.
+    const auto ptr = static_cast<const u8*>(contents);
+    data_struct->data.insert(data_struct->data.end(), ptr, ptr + realsize);
     data_struct->offset += realsize;
 
+    if (data_struct->hash) {
+        data_struct->hash->Update(contents, realsize);
+    }
+
+    Yield();
+    return realsize;
+}
+
+auto WriteDataCallback(void *contents, size_t size, size_t num_files, void *userp) -> size_t {
+    if (!g_running) {
+        return 0;
+    }
+
+    auto data_struct = static_cast<DataStruct*>(userp);
+    const auto realsize = size * num_files;
+
+    if (data_struct->hash) {
+        data_struct->hash->Update(contents, realsize);
+    }
+
+    if (!(*data_struct->on_data)(contents, realsize)) {
+        return 0;
+    }
+
     Yield();
     return realsize;
 }
@@ -512,6 +733,25 @@ auto WriteFileCallback(void *contents, size_t size, size_t num_files, void *user
     auto data_struct = static_cast<DataStruct*>(userp);
     const auto realsize = size * num_files;
 
+    // if the server ignored the range, it's sending the full file.
+    if (data_struct->check_range) {
+        data_struct->check_range = false;
+
+        long http_code = 0;
+        curl_easy_getinfo(data_struct->curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code != 206) {
+            log_write("[CURL] range not used, restarting download, code: %ld\n", http_code);
+            if (R_FAILED(data_struct->f.SetSize(0))) {
+                return 0;
+            }
+
+            data_struct->file_offset = 0;
+            if (data_struct->hash) {
+                data_struct->hash = hash::Create(data_struct->hash_type);
+            }
+        }
+    }
+
     // flush data if incomming data would overflow the buffer
     if (data_struct->offset && data_struct->data.size() < data_struct->offset + realsize) {
         if (R_FAILED(data_struct->f.Write(data_struct->file_offset, data_struct->data.data(), data_struct->offset, FsWriteOption_None))) {
@@ -535,10 +775,47 @@ auto WriteFileCallback(void *contents, size_t size, size_t num_files, void *user
         data_struct->offset += realsize;
     }
 
+    if (data_struct->hash) {
+        data_struct->hash->Update(contents, realsize);
+    }
+
     Yield();
     return realsize;
 }
 
+auto WriteSegmentCallback(void *contents, size_t size, size_t num_files, void *userp) -> size_t {
+    if (!g_running) {
+        return 0;
+    }
+
+    auto segment = static_cast<Segment*>(userp);
+    const auto realsize = size * num_files;
+
+    // the data would be written to the wrong offset if the range was ignored.
+    if (!segment->checked) {
+        segment->checked = true;
+
+        long http_code = 0;
+        curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code != 206) {
+            log_write("[CURL] segment range not used, code: %ld\n", http_code);
+            return 0;
+        }
+    }
+
+    if (segment->written + (s64)realsize > segment->size) {
+        log_write("[CURL] segment received too much data\n");
+        return 0;
+    }
+
+    if (R_FAILED(segment->parent->file.Write(segment->offset + segment->written, contents, realsize, FsWriteOption_None))) {
+        return 0;
+    }
+
+    segment->written += realsize;
+    return realsize;
+}
+
 auto header_callback(char* b, size_t size, size_t nitems, void* userdata) -> size_t {
     auto header = static_cast<Header*>(userdata);
     const auto numbytes = size * nitems;
@@ -605,6 +882,30 @@ auto EncodeUrl(std::string url) -> std::string {
     return out;
 }
 
+auto CreateHeaderList(const Header& header) -> curl_slist* {
+    struct curl_slist* list = NULL;
+
+    for (const auto& [key, value] : header.m_map) {
+        if (value.empty()) {
+            continue;
+        }
+
+        // create header key value pair.
+        const auto header_str = key + ": " + value;
+
+        // try to append header chunk.
+        auto temp = curl_slist_append(list, header_str.c_str());
+        if (temp) {
+            log_write("adding header: %s\n", header_str.c_str());
+            list = temp;
+        } else {
+            log_write("failed to append header\n");
+        }
+    }
+
+    return list;
+}
+
 void SetCommonCurlOptions(CURL* curl, const Api& e) {
     CURL_EASY_SETOPT_LOG(curl, CURLOPT_USERAGENT, API_AGENT);
     CURL_EASY_SETOPT_LOG(curl, CURLOPT_FOLLOWLOCATION, 1L);
@@ -628,6 +929,17 @@ void SetCommonCurlOptions(CURL* curl, const Api& e) {
     // enable TE is server supports it.
     CURL_EASY_SETOPT_LOG(curl, CURLOPT_TRANSFER_ENCODING, 1L);
 
+    // keep connections alive so that they can be reused by later requests,
+    // avoiding a new tls handshake each time.
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_MAXCONNECTS, CONNECTION_POOL_SIZE);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_MAXAGE_CONN, CONNECTION_MAX_IDLE);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_DNS_CACHE_TIMEOUT, DNS_CACHE_TIMEOUT);
+
+    // for http/2, wait to find out if an existing connection can be
+    // multiplexed rather than opening a new one. this has no effect on http/1.1.
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_PIPEWAIT, 1L);
+
     // set flags.
     if (e.GetFlags() & Flag_NoBody) {
         CURL_EASY_SETOPT_LOG(curl, CURLOPT_NOBODY, 1L);
@@ -674,117 +986,349 @@ void SetCommonCurlOptions(CURL* curl, const Api& e) {
     }
 
 }
-auto DownloadInternal(CURL* curl, const Api& e) -> ApiResult {
-    App::SetAutoSleepDisabled(true);
-    ON_SCOPE_EXIT(App::SetAutoSleepDisabled(false));
 
-    // check if stop has been requested before starting download
-    if (e.GetToken().stop_requested()) {
-        return {};
+// continues the partial download from a previous attempt.
+// if the file changed on the server, the server ignores the range and sends
+// the full file, which is handled in WriteFileCallback().
+void SetupResume(fs::FsNativeSd& fs, const fs::FsPath& path, const std::string& url, DataStruct& chunk, Header& header) {
+    s64 size{};
+    if (R_FAILED(chunk.f.GetSize(&size)) || !size) {
+        return;
+    }
+
+    // the partial download may be of a different file with the same dst path.
+    fs::FsPath url_path;
+    GetDownloadResumeUrlPath(path, url_path);
+    std::vector<u8> url_data;
+    if (R_FAILED(fs.read_entire_file(url_path, url_data)) || std::string_view{(const char*)url_data.data(), url_data.size()} != url) {
+        log_write("[CURL] partial download is of a different url, restarting\n");
+        chunk.f.SetSize(0);
+        return;
+    }
+
+    const auto validator = g_cache.get_validator(path);
+    if (validator.empty()) {
+        log_write("[CURL] partial download has no etag / last-modified, restarting\n");
+        chunk.f.SetSize(0);
+        return;
+    }
+
+    // hash the data that was already downloaded.
+    if (chunk.hash) {
+        std::vector<u8> buf(CHUNK_SIZE);
+        for (s64 off = 0; off < size;) {
+            u64 bytes_read;
+            if (R_FAILED(chunk.f.Read(off, buf.data(), std::min<s64>(buf.size(), size - off), 0, &bytes_read)) || !bytes_read) {
+                log_write("[CURL] failed to read partial download, restarting\n");
+                chunk.hash = hash::Create(chunk.hash_type);
+                chunk.f.SetSize(0);
+                return;
+            }
+
+            chunk.hash->Update(buf.data(), bytes_read);
+            off += bytes_read;
+        }
     }
 
-    fs::FsPath tmp_buf;
-    const bool has_file = !e.GetPath().empty() && e.GetPath() != "";
-    const bool has_post = !e.GetFields().empty() && e.GetFields() != "";
+    log_write("[CURL] resuming download from: %zd\n", size);
+    chunk.file_offset = size;
+    chunk.check_range = true;
+    header.m_map.insert_or_assign("range", "bytes=" + std::to_string(size) + "-");
+    header.m_map.insert_or_assign("if-range", validator);
+}
+
+// downloads the file in byte ranges in parallel into a preallocated file.
+// returns false if the server does not support ranges, in which case the
+// file should be downloaded normally.
+auto DownloadSegmented(CURL* curl, const Api& e, ApiResult& out) -> bool {
     const auto encoded_url = EncodeUrl(e.GetUrl());
+    auto list = CreateHeaderList(e.GetHeader());
+    ON_SCOPE_EXIT(if (list) { curl_slist_free_all(list); } );
 
-    DataStruct chunk;
-    Header header_in = e.GetHeader();
+    // get the size and check that ranges are supported.
+    // compression is disabled as the ranges are of the uncompressed file.
     Header header_out;
+    curl_easy_reset(curl);
+    SetCommonCurlOptions(curl, e);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_URL, encoded_url.c_str());
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_NOBODY, 1L);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_ACCEPT_ENCODING, nullptr);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_HEADERDATA, &header_out);
+    if (list) {
+        CURL_EASY_SETOPT_LOG(curl, CURLOPT_HTTPHEADER, list);
+    }
+
+    if (curl_easy_perform(curl) != CURLE_OK) {
+        log_write("[CURL] segmented head request failed\n");
+        return false;
+    }
+
+    curl_off_t size = -1;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+    const auto accept_ranges = header_out.Find("accept-ranges");
+    if (accept_ranges == header_out.m_map.end() || accept_ranges->second.find("bytes") == std::string::npos || size < SEGMENTED_MIN_SIZE) {
+        log_write("[CURL] segmented download not possible, size: %zd\n", (s64)size);
+        return false;
+    }
+
     fs::FsNativeSd fs;
+    fs::FsPath tmp_buf;
+    GetDownloadTempPath(tmp_buf);
+    fs.CreateDirectoryRecursivelyWithPath(tmp_buf);
+    fs.DeleteFile(tmp_buf);
 
-    if (has_file) {
-        GetDownloadTempPath(tmp_buf);
+    if (R_FAILED(fs.CreateFile(tmp_buf, size, 0))) {
+        log_write("failed to create file: %s\n", tmp_buf.s);
+        return false;
+    }
+    ON_SCOPE_EXIT(fs.DeleteFile(tmp_buf));
+
+    SegmentedDownload download{&e};
+    download.size = size;
+    if (R_FAILED(fs.OpenFile(tmp_buf, FsOpenMode_Write, &download.file))) {
+        log_write("failed to open file: %s\n", tmp_buf.s);
+        return false;
+    }
+
+    auto multi = curl_multi_init();
+    if (!multi) {
+        return false;
+    }
+    ON_SCOPE_EXIT(curl_multi_cleanup(multi));
+
+    // the segments are never resized, the callbacks point into the vector.
+    const auto count = std::min(e.GetSegments().m_count, SEGMENTED_MAX_COUNT);
+    download.segments.resize(count);
+    ON_SCOPE_EXIT(
+        for (auto& segment : download.segments) {
+            if (segment.curl) {
+                curl_multi_remove_handle(multi, segment.curl);
+                curl_easy_cleanup(segment.curl);
+            }
+        }
+    );
+
+    const auto segment_size = size / count;
+    for (u32 i = 0; i < count; i++) {
+        auto& segment = download.segments[i];
+        segment.parent = &download;
+        segment.offset = i * segment_size;
+        segment.size = i == count - 1 ? size - segment.offset : segment_size;
+        segment.range = std::to_string(segment.offset) + "-" + std::to_string(segment.offset + segment.size - 1);
+
+        segment.curl = curl_easy_init();
+        if (!segment.curl) {
+            return false;
+        }
+
+        SetCommonCurlOptions(segment.curl, e);
+        CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_URL, encoded_url.c_str());
+        CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_ACCEPT_ENCODING, nullptr);
+        CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_RANGE, segment.range.c_str());
+        CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_WRITEFUNCTION, WriteSegmentCallback);
+        CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_WRITEDATA, &segment);
+        CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_XFERINFODATA, &segment);
+        CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_XFERINFOFUNCTION, ProgressCallbackSegment);
+        if (list) {
+            CURL_EASY_SETOPT_LOG(segment.curl, CURLOPT_HTTPHEADER, list);
+        }
+
+        curl_multi_add_handle(multi, segment.curl);
+    }
+
+    log_write("[CURL] starting segmented download, size: %zd segments: %u\n", (s64)size, count);
+
+    int running{};
+    bool failed{};
+    bool cancelled{};
+    do {
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            failed = true;
+            break;
+        }
+
+        // stop all segments if one of them failed.
+        int msgs_left;
+        while (auto msg = curl_multi_info_read(multi, &msgs_left)) {
+            if (msg->msg == CURLMSG_DONE && msg->data.result != CURLE_OK) {
+                log_write("[CURL] segment failed: %s\n", curl_easy_strerror(msg->data.result));
+                failed = true;
+                cancelled |= msg->data.result == CURLE_ABORTED_BY_CALLBACK;
+            }
+        }
+
+        if (!failed && running) {
+            curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+        }
+    } while (!failed && running && g_running && !e.GetToken().stop_requested());
+
+    bool success = !failed && !running;
+    for (const auto& segment : download.segments) {
+        success &= segment.written == segment.size;
+    }
+
+    download.file.Close();
+
+    // fallback to a single download, which can be retried / resumed,
+    // unless the user cancelled.
+    cancelled |= !g_running || e.GetToken().stop_requested();
+    if (!success && !cancelled) {
+        log_write("[CURL] segmented download failed, falling back to single download\n");
+        return false;
+    }
+
+    if (success) {
+        fs.DeleteFile(e.GetPath());
+        fs.CreateDirectoryRecursivelyWithPath(e.GetPath());
+        if (R_FAILED(fs.RenameFile(tmp_buf, e.GetPath()))) {
+            success = false;
+        }
+    }
+
+    log_write("Downloaded %s segmented: %s\n", e.GetUrl().c_str(), success ? "success" : "failed");
+    out = {success, success ? 200 : 0, header_out, {}, e.GetPath(), {}};
+    return true;
+}
+
+auto DownloadSetup(CURL* curl, const Api& e, DownloadState& s) -> bool {
+    auto& chunk = s.chunk;
+    auto& fs = s.fs;
+    auto& tmp_buf = s.tmp_buf;
+
+    s.has_file = !e.GetPath().empty() && e.GetPath() != "";
+    s.has_post = !e.GetFields().empty() && e.GetFields() != "";
+    s.resume = s.has_file && (e.GetFlags() & Flag_Resume);
+    s.encoded_url = EncodeUrl(e.GetUrl());
+    s.header_in = e.GetHeader();
+
+    if (s.has_file) {
+        if (s.resume) {
+            GetDownloadResumePath(e.GetPath(), tmp_buf);
+        } else {
+            GetDownloadTempPath(tmp_buf);
+        }
         fs.CreateDirectoryRecursivelyWithPath(tmp_buf);
 
         if (auto rc = fs.CreateFile(tmp_buf, 0, 0); R_FAILED(rc) && rc != FsError_PathAlreadyExists) {
             log_write("failed to create file: %s\n", tmp_buf.s);
-            return {};
+            return false;
         }
 
-        if (R_FAILED(fs.OpenFile(tmp_buf, FsOpenMode_Write|FsOpenMode_Append, &chunk.f))) {
+        // read is needed to hash the partial download when resuming.
+        const u32 mode = s.resume ? FsOpenMode_Read|FsOpenMode_Write|FsOpenMode_Append : FsOpenMode_Write|FsOpenMode_Append;
+        if (R_FAILED(fs.OpenFile(tmp_buf, mode, &chunk.f))) {
             log_write("failed to open file: %s\n", tmp_buf.s);
-            return {};
+            return false;
         }
 
         // only add etag if the dst file still exists.
         if ((e.GetFlags() & Flag_Cache) && fs::FileExists(&fs.m_fs, e.GetPath())) {
-            g_cache.get(e.GetPath(), header_in);
+            g_cache.get(e.GetPath(), s.header_in);
         }
     }
 
-    // reserve the first chunk
-    chunk.data.reserve(CHUNK_SIZE);
+    // reserve the first chunk, memory downloads are sized on the first write.
+    if (s.has_file) {
+        chunk.data.reserve(CHUNK_SIZE);
+    }
+    chunk.curl = curl;
+
+    if (e.GetHash().m_enabled) {
+        chunk.hash = hash::Create(e.GetHash().m_type);
+        chunk.hash_type = e.GetHash().m_type;
+    }
+
+    if (s.resume) {
+        SetupResume(fs, tmp_buf, e.GetUrl(), chunk, s.header_in);
+    }
 
     curl_easy_reset(curl);
     SetCommonCurlOptions(curl, e);
 
-    CURL_EASY_SETOPT_LOG(curl, CURLOPT_URL, encoded_url.c_str());
+    // ranges are of the encoded data, which can't be decoded part way.
+    if (s.resume) {
+        CURL_EASY_SETOPT_LOG(curl, CURLOPT_ACCEPT_ENCODING, nullptr);
+    }
+
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_URL, s.encoded_url.c_str());
     CURL_EASY_SETOPT_LOG(curl, CURLOPT_HEADERFUNCTION, header_callback);
-    CURL_EASY_SETOPT_LOG(curl, CURLOPT_HEADERDATA, &header_out);
+    CURL_EASY_SETOPT_LOG(curl, CURLOPT_HEADERDATA, &s.header_out);
 
-    if (has_post) {
+    if (s.has_post) {
         CURL_EASY_SETOPT_LOG(curl, CURLOPT_POSTFIELDS, e.GetFields().c_str());
         log_write("setting post field: %s\n", e.GetFields().c_str());
     }
 
-    struct curl_slist* list = NULL;
-    ON_SCOPE_EXIT(if (list) { curl_slist_free_all(list); } );
-
-    for (const auto& [key, value] : header_in.m_map) {
-        if (value.empty()) {
-            continue;
-        }
-
-        // create header key value pair.
-        const auto header_str = key + ": " + value;
-
-        // try to append header chunk.
-        auto temp = curl_slist_append(list, header_str.c_str());
-        if (temp) {
-            log_write("adding header: %s\n", header_str.c_str());
-            list = temp;
-        } else {
-            log_write("failed to append header\n");
-        }
-    }
-
-    if (list) {
-        CURL_EASY_SETOPT_LOG(curl, CURLOPT_HTTPHEADER, list);
+    s.list = CreateHeaderList(s.header_in);
+    if (s.list) {
+        CURL_EASY_SETOPT_LOG(curl, CURLOPT_HTTPHEADER, s.list);
     }
 
     // write calls.
-    CURL_EASY_SETOPT_LOG(curl, CURLOPT_WRITEFUNCTION, has_file ? WriteFileCallback : WriteMemoryCallback);
+    if (s.has_file) {
+        CURL_EASY_SETOPT_LOG(curl, CURLOPT_WRITEFUNCTION, WriteFileCallback);
+    } else if (e.GetOnData()) {
+        chunk.on_data = &e.GetOnData();
+        CURL_EASY_SETOPT_LOG(curl, CURLOPT_WRITEFUNCTION, WriteDataCallback);
+    } else {
+        CURL_EASY_SETOPT_LOG(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    }
     CURL_EASY_SETOPT_LOG(curl, CURLOPT_WRITEDATA, &chunk);
 
-    // perform download and cleanup after and report the result.
-    const auto res = curl_easy_perform(curl);
+    return true;
+}
+
+// cleanup after the download and report the result.
+auto DownloadFinish(CURL* curl, const Api& e, DownloadState& s, CURLcode res) -> ApiResult {
+    auto& chunk = s.chunk;
+    auto& fs = s.fs;
+    const auto& tmp_buf = s.tmp_buf;
     bool success = res == CURLE_OK;
 
     long http_code = 0;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
-    if (has_file) {
-        ON_SCOPE_EXIT( fs.DeleteFile(tmp_buf) );
-        if (res == CURLE_OK && chunk.offset) {
+    if (s.has_file) {
+        // keep the partial download to resume it on the next attempt, unless
+        // the server returned an error, such as the file no longer existing,
+        // or the user cancelled the download.
+        const bool keep_partial = s.resume && res != CURLE_OK && res != CURLE_ABORTED_BY_CALLBACK && http_code < 400;
+        fs::FsPath url_path;
+        GetDownloadResumeUrlPath(tmp_buf, url_path);
+        ON_SCOPE_EXIT(
+            if (!keep_partial) {
+                fs.DeleteFile(tmp_buf);
+                if (s.resume) {
+                    fs.DeleteFile(url_path);
+                }
+            }
+        );
+
+        if ((res == CURLE_OK || keep_partial) && chunk.offset) {
             chunk.f.Write(chunk.file_offset, chunk.data.data(), chunk.offset, FsWriteOption_None);
         }
 
         chunk.f.Close();
 
+        if (keep_partial) {
+            g_cache.set(tmp_buf, s.header_out);
+            fs.write_entire_file(url_path, std::vector<u8>(e.GetUrl().begin(), e.GetUrl().end()));
+        }
+
         if (res == CURLE_OK) {
             if (http_code == 304) {
                 log_write("cached download: %s\n", e.GetUrl().c_str());
             } else {
                 log_write("un-cached download: %s code: %lu\n", e.GetUrl().c_str(), http_code);
                 if (e.GetFlags() & Flag_Cache) {
-                    g_cache.set(e.GetPath(), header_out);
+                    g_cache.set(e.GetPath(), s.header_out);
                 }
 
                 // enable to log received headers.
                 #if 0
                 log_write("\n\nLOGGING HEADER\n");
-                    for (auto [a, b] : header_out.m_map) {
+                    for (auto [a, b] : s.header_out.m_map) {
                         log_write("\t%s: %s\n", a.c_str(), b.c_str());
                     }
                 log_write("\n\n");
@@ -805,8 +1349,65 @@ auto DownloadInternal(CURL* curl, const Api& e) -> ApiResult {
         }
     }
 
+    // a cached (304) download has no body, so there's nothing to hash.
+    std::string hash_out;
+    if (chunk.hash && res == CURLE_OK && http_code != 304) {
+        chunk.hash->Get(hash_out);
+    }
+
     log_write("Downloaded %s code: %ld %s\n", e.GetUrl().c_str(), http_code, curl_easy_strerror(res));
-    return {success, http_code, header_out, chunk.data, e.GetPath()};
+    return {success, http_code, s.header_out, std::move(chunk.data), e.GetPath(), hash_out};
+}
+
+auto DownloadInternalSingle(CURL* curl, const Api& e, CURLcode& res) -> ApiResult {
+    DownloadState state{};
+    if (!DownloadSetup(curl, e, state)) {
+        res = CURLE_FAILED_INIT;
+        return {};
+    }
+
+    // perform download and cleanup after and report the result.
+    res = curl_easy_perform(curl);
+    return DownloadFinish(curl, e, state, res);
+}
+
+auto DownloadInternal(CURL* curl, const Api& e) -> ApiResult {
+    App::SetAutoSleepDisabled(true);
+    ON_SCOPE_EXIT(App::SetAutoSleepDisabled(false));
+
+    // check if stop has been requested before starting download
+    if (e.GetToken().stop_requested()) {
+        return {};
+    }
+
+    const bool has_file = !e.GetPath().empty() && e.GetPath() != "";
+    const bool has_post = !e.GetFields().empty() && e.GetFields() != "";
+
+    if (has_file && !has_post && e.GetSegments().m_count > 1 && !(e.GetFlags() & Flag_Cache) && !e.GetHash().m_enabled) {
+        ApiResult result{};
+        if (DownloadSegmented(curl, e, result)) {
+            return result;
+        }
+    }
+
+    CURLcode res;
+    auto result = DownloadInternalSingle(curl, e, res);
+
+    // the partial download is kept on failure, so retrying continues from
+    // where it stopped. only network errors are retried.
+    if (has_file && (e.GetFlags() & Flag_Resume)) {
+        for (u32 i = 0; i < RESUME_MAX_RETRIES && !result.success && IsTransientError(res); i++) {
+            if (!g_running || e.GetToken().stop_requested()) {
+                break;
+            }
+
+            log_write("[CURL] retrying download: %u\n", i + 1);
+            svcSleepThread(1e+9);
+            result = DownloadInternalSingle(curl, e, res);
+        }
+    }
+
+    return result;
 }
 
 auto UploadInternal(CURL* curl, const Api& e) -> ApiResult {
@@ -861,8 +1462,8 @@ auto UploadInternal(CURL* curl, const Api& e) -> ApiResult {
         fs.DeleteFile(folder_path);
     }
 
-    // reserve the first chunk
-    chunk_out.data.reserve(CHUNK_SIZE);
+    // the response is sized on the first write.
+    chunk_out.curl = curl;
 
     curl_easy_reset(curl);
     SetCommonCurlOptions(curl, e);
@@ -877,27 +1478,9 @@ auto UploadInternal(CURL* curl, const Api& e) -> ApiResult {
     // instruct libcurl to create ftp folders if they don't yet exist.
     CURL_EASY_SETOPT_LOG(curl, CURLOPT_FTP_CREATE_MISSING_DIRS, CURLFTP_CREATE_DIR_RETRY);
 
-    struct curl_slist* list = NULL;
+    auto list = CreateHeaderList(header_in);
     ON_SCOPE_EXIT(if (list) { curl_slist_free_all(list); } );
 
-    for (const auto& [key, value] : header_in.m_map) {
-        if (value.empty()) {
-            continue;
-        }
-
-        // create header key value pair.
-        const auto header_str = key + ": " + value;
-
-        // try to append header chunk.
-        auto temp = curl_slist_append(list, header_str.c_str());
-        if (temp) {
-            log_write("adding header: %s\n", header_str.c_str());
-            list = temp;
-        } else {
-            log_write("failed to append header\n");
-        }
-    }
-
     if (list) {
         CURL_EASY_SETOPT_LOG(curl, CURLOPT_HTTPHEADER, list);
     }
@@ -938,7 +1521,7 @@ auto UploadInternal(CURL* curl, const Api& e) -> ApiResult {
     }
 
     log_write("Uploaded %s code: %ld %s\n", url.c_str(), http_code, curl_easy_strerror(res));
-    return {success, http_code, header_out, chunk_out.data};
+    return {success, http_code, header_out, std::move(chunk_out.data)};
 }
 
 auto WebdavCreateFolder(CURL* curl, const Api& e) -> bool {
@@ -1019,6 +1602,20 @@ void my_unlock(CURL *handle, curl_lock_data data, void *useptr) {
     mutexUnlock(&g_mutex_share[data]);
 }
 
+// transfers that can't be driven by the multi handle.
+auto IsBlocking(const Api& api) -> bool {
+    return api.IsUpload() || (api.GetFlags() & Flag_Resume) || api.GetSegments().m_count > 1;
+}
+
+void PushResult(const Api& api, const ApiResult& result) {
+    if (g_running && api.GetOnComplete() && !api.GetToken().stop_requested()) {
+        evman::push(
+            DownloadEventData{api.GetOnComplete(), result, api.GetToken()},
+            false
+        );
+    }
+}
+
 void ThreadEntry::ThreadFunc(void* p) {
     auto data = static_cast<ThreadEntry*>(p);
     while (g_running) {
@@ -1033,73 +1630,135 @@ void ThreadEntry::ThreadFunc(void* p) {
         }
 
         const auto result = data->m_api.IsUpload() ? UploadInternal(data->m_curl, data->m_api) : DownloadInternal(data->m_curl, data->m_api);
-        if (g_running && data->m_api.GetOnComplete() && !data->m_api.GetToken().stop_requested()) {
-            evman::push(
-                DownloadEventData{data->m_api.GetOnComplete(), result, data->m_api.GetToken()},
-                false
-            );
-        }
+        PushResult(data->m_api, result);
 
         data->m_in_progress = false;
-        // notify the queue that there's a space free
-        ueventSignal(&g_thread_queue.m_uevent);
+        // notify the queue that the worker is free
+        g_thread_queue.Wakeup();
     }
     log_write("exited download thread\n");
 }
 
-void ThreadQueue::ThreadFunc(void* p) {
-    auto data = static_cast<ThreadQueue*>(p);
-    while (g_running) {
-        auto rc = waitSingle(waiterForUEvent(&data->m_uevent), UINT64_MAX);
-        log_write("[thread queue] woke up\n");
-        if (!g_running) {
-            return;
+void ThreadQueue::StartTransfers() {
+    mutexLock(&m_mutex);
+    ON_SCOPE_EXIT(mutexUnlock(&m_mutex));
+
+    for (auto it = m_entries.begin(); it != m_entries.end() && g_running;) {
+        // drop entries that were cancelled whilst queued.
+        if (it->GetToken().stop_requested()) {
+            it = m_entries.erase(it);
+            continue;
         }
-        if (R_FAILED(rc)) {
+
+        if (IsBlocking(*it)) {
+            if (!g_worker.InProgress() && g_worker.Setup(*it)) {
+                it = m_entries.erase(it);
+            } else {
+                it++;
+            }
             continue;
         }
 
-        mutexLock(&data->m_mutex);
-        ON_SCOPE_EXIT(mutexUnlock(&data->m_mutex));
-        if (data->m_entries.empty()) {
+        // keep some transfers free so that high priority entries can start
+        // whilst lots of normal entries are in flight.
+        auto max_transfers = MULTI_MAX_TRANSFERS;
+        if (it->GetPriority() == Priority::Normal) {
+            max_transfers -= MULTI_HIGH_PRIO_RESERVED;
+        }
+
+        if (m_transfers.size() >= max_transfers) {
+            it++;
             continue;
         }
 
-        // find the next avaliable thread
-        u32 pop_count{};
-        for (auto& entry : data->m_entries) {
-            if (!g_running) {
-                return;
-            }
+        auto transfer = std::make_unique<MultiTransfer>();
+        transfer->api = std::move(*it);
+        it = m_entries.erase(it);
 
-            bool keep_going{};
+        if (!m_handles.empty()) {
+            transfer->curl = m_handles.back();
+            m_handles.pop_back();
+        } else {
+            transfer->curl = curl_easy_init();
+        }
 
-            for (auto& thread : g_threads) {
-                if (!g_running) {
-                    return;
-                }
+        if (!transfer->curl) {
+            log_write("[thread queue] failed to create curl handle\n");
+            PushResult(transfer->api, {});
+            continue;
+        }
 
-                if (!thread.InProgress()) {
-                    thread.Setup(entry.api);
-                    // log_write("[dl queue] starting download\n");
-                    // mark entry for deletion
-                    entry.m_delete = true;
-                    pop_count++;
-                    keep_going = true;
-                    break;
-                }
-            }
+        if (!DownloadSetup(transfer->curl, transfer->api, transfer->state) || curl_multi_add_handle(m_multi, transfer->curl) != CURLM_OK) {
+            log_write("[thread queue] failed to start transfer: %s\n", transfer->api.GetUrl().c_str());
+            m_handles.emplace_back(transfer->curl);
+            PushResult(transfer->api, {});
+            continue;
+        }
 
-            if (!keep_going) {
-                break;
-            }
+        App::SetAutoSleepDisabled(true);
+        m_transfers.emplace_back(std::move(transfer));
+    }
+}
+
+void ThreadQueue::FinishTransfers() {
+    int msgs_left;
+    while (auto msg = curl_multi_info_read(m_multi, &msgs_left)) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        // msg is freed on remove, so copy out what's needed.
+        const auto curl = msg->easy_handle;
+        const auto res = msg->data.result;
+
+        const auto it = std::ranges::find_if(m_transfers, [curl](auto& e) {
+            return e->curl == curl;
+        });
+
+        if (it != m_transfers.end()) {
+            FinishTransfer(*it, res);
+            m_transfers.erase(it);
         }
+    }
 
-        // delete all entries marked for deletion
-        for (u32 i = 0; i < pop_count; i++) {
-            data->m_entries.pop_front();
+    // remove cancelled transfers now, rather than waiting for curl to call
+    // the progress callback, which may not happen on a stalled transfer.
+    for (auto it = m_transfers.begin(); it != m_transfers.end();) {
+        if ((*it)->api.GetToken().stop_requested()) {
+            FinishTransfer(*it, CURLE_ABORTED_BY_CALLBACK);
+            it = m_transfers.erase(it);
+        } else {
+            it++;
         }
     }
+}
+
+void ThreadQueue::FinishTransfer(std::unique_ptr<MultiTransfer>& transfer, CURLcode res) {
+    curl_multi_remove_handle(m_multi, transfer->curl);
+    const auto result = DownloadFinish(transfer->curl, transfer->api, transfer->state, res);
+    App::SetAutoSleepDisabled(false);
+
+    PushResult(transfer->api, result);
+    m_handles.emplace_back(transfer->curl);
+}
+
+void ThreadQueue::ThreadFunc(void* p) {
+    auto data = static_cast<ThreadQueue*>(p);
+    while (g_running) {
+        data->StartTransfers();
+
+        int running{};
+        if (auto rc = curl_multi_perform(data->m_multi, &running); rc != CURLM_OK) {
+            log_write("[thread queue] curl_multi_perform() failed: %s\n", curl_multi_strerror(rc));
+        }
+
+        data->FinishTransfers();
+
+        // sleep until there's activity on a transfer or Add() wakes us up.
+        // the timeout is only used to check for cancelled transfers.
+        const auto timeout = data->m_transfers.empty() ? 1000*60 : 250;
+        curl_multi_poll(data->m_multi, nullptr, 0, timeout, nullptr);
+    }
 
     log_write("exited download thread queue\n");
 }
@@ -1128,10 +1787,8 @@ auto Init() -> bool {
         log_write("!failed to create download thread queue\n");
     }
 
-    for (auto& entry : g_threads) {
-        if (R_FAILED(entry.Create())) {
-            log_write("!failed to create download thread\n");
-        }
+    if (R_FAILED(g_worker.Create())) {
+        log_write("!failed to create download thread\n");
     }
 
     g_curl_single = curl_easy_init();
@@ -1158,9 +1815,7 @@ void Exit() {
         g_curl_single = nullptr;
     }
 
-    for (auto& entry : g_threads) {
-        entry.Close();
-    }
+    g_worker.Close();
 
     if (g_curl_share) {
         curl_share_cleanup(g_curl_share);
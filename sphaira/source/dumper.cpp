@@ -40,6 +40,10 @@ struct UsbTest final : usb::upload::Usb, yati::source::Stream {
         m_source = source;
     }
 
+    ~UsbTest() {
+        WaitForPrefetch();
+    }
+
     Result ReadChunk(void* buf, s64 size, u64* bytes_read) override {
         R_TRY(m_pull(buf, size, bytes_read));
         m_pull_offset += *bytes_read;
@@ -54,6 +58,15 @@ struct UsbTest final : usb::upload::Usb, yati::source::Stream {
         }
     }
 
+    auto GetFileSize(const std::string& path) -> s64 override {
+        // the stream transfer already reads ahead on its own thread.
+        if (m_pull) {
+            return 0;
+        }
+
+        return m_source->GetSize(path);
+    }
+
     Result ReadInternal(const std::string& path, void* buf, s64 off, s64 size, u64* bytes_read) {
         if (m_path != path) {
             m_path = path;
@@ -98,10 +111,209 @@ private:
     s64 m_pull_offset{};
 };
 
+// files at or below this size are dumped on worker threads whilst the larger
+// files are dumped, as their setup (create, open, rename) costs more than the data.
+constexpr s64 SMALL_FILE_MAX_SIZE = 1024 * 1024 * 8;
+// max amount of small file data held in memory at once, across all workers.
+constexpr s64 SMALL_FILE_MEMORY_BUDGET = 1024 * 1024 * 16;
+// max number of workers for small files.
+constexpr u32 SMALL_FILE_MAX_THREADS = 3;
+// same as above, but for applet mode, where the large file transfer
+// buffers leave far less memory.
+constexpr s64 APPLET_SMALL_FILE_MEMORY_BUDGET = 1024 * 1024 * 4;
+constexpr u32 APPLET_SMALL_FILE_MAX_THREADS = 1;
+
+using OnSmallFile = std::function<Result(const fs::FsPath& path, std::span<const u8> data)>;
+using OnLargeFile = std::function<Result(const fs::FsPath& path)>;
+
+struct SmallFiles {
+    ui::ProgressBox* pbox;
+    BaseSource* source;
+    const OnSmallFile& on_file;
+    std::vector<fs::FsPath> paths{};
+    s64 total_size{};
+    s64 memory_budget{SMALL_FILE_MEMORY_BUDGET};
+
+    Mutex mutex{};
+    // signalled when a file finishes, or on error.
+    CondVar can_run{};
+    size_t index{};
+    size_t files_done{};
+    s64 memory_used{};
+    s64 bytes_done{};
+    Result rc{};
+};
+
+Result DumpSmallFile(SmallFiles* t, const fs::FsPath& path, s64 size) {
+    R_TRY(t->pbox->ShouldExitResult());
+
+    std::vector<u8> buf(size);
+    for (s64 off = 0; off < size;) {
+        u64 bytes_read;
+        R_TRY(t->source->Read(path, buf.data() + off, off, size - off, &bytes_read));
+        R_UNLESS(bytes_read, Result_DumpBadReadSize);
+        off += bytes_read;
+    }
+
+    return t->on_file(path, buf);
+}
+
+void SmallFilesThreadFunc(void* arg) {
+    auto t = static_cast<SmallFiles*>(arg);
+
+    while (true) {
+        fs::FsPath path;
+        s64 size;
+        {
+            SCOPED_MUTEX(&t->mutex);
+            if (R_FAILED(t->rc) || t->index >= t->paths.size()) {
+                break;
+            }
+
+            path = t->paths[t->index++];
+            size = t->source->GetSize(path);
+
+            // wait for the file to fit in the budget, a file is always
+            // allowed to run if nothing else is in memory.
+            while (t->memory_used && t->memory_used + size > t->memory_budget && R_SUCCEEDED(t->rc)) {
+                condvarWait(&t->can_run, &t->mutex);
+            }
+
+            if (R_FAILED(t->rc)) {
+                break;
+            }
+
+            t->memory_used += size;
+        }
+
+        const auto rc = DumpSmallFile(t, path, size);
+        if (R_FAILED(rc)) {
+            log_write("[DUMP] failed to dump small file: %s 0x%X\n", path.s, rc);
+        }
+
+        SCOPED_MUTEX(&t->mutex);
+        t->memory_used -= size;
+        t->bytes_done += size;
+        t->files_done++;
+        if (R_SUCCEEDED(t->rc)) {
+            t->rc = rc;
+        }
+        condvarWakeAll(&t->can_run);
+    }
+}
+
+// dumps the small files on up to threads workers, whilst the large files are
+// dumped in order on the calling thread.
+// with less than 2 small files, everything is dumped in order.
+Result DumpScheduled(ui::ProgressBox* pbox, BaseSource* source, std::span<const fs::FsPath> paths, u32 threads, const OnSmallFile& on_small, const OnLargeFile& on_large) {
+    SmallFiles t{pbox, source, on_small};
+    std::vector<fs::FsPath> large;
+
+    for (const auto& path : paths) {
+        const auto size = source->GetSize(path);
+        if (size <= SMALL_FILE_MAX_SIZE) {
+            t.paths.emplace_back(path);
+            t.total_size += size;
+        } else {
+            large.emplace_back(path);
+        }
+    }
+
+    if (App::IsApplet()) {
+        threads = std::min(threads, APPLET_SMALL_FILE_MAX_THREADS);
+        t.memory_budget = APPLET_SMALL_FILE_MEMORY_BUDGET;
+    }
+
+    threads = std::min<u32>({threads, SMALL_FILE_MAX_THREADS, (u32)t.paths.size()});
+    if (threads < 1 || t.paths.size() < 2) {
+        for (const auto& path : paths) {
+            R_TRY(on_large(path));
+        }
+
+        R_SUCCEED();
+    }
+
+    log_write("[DUMP] small files: %zu large files: %zu threads: %u\n", t.paths.size(), large.size(), threads);
+    mutexInit(&t.mutex);
+    condvarInit(&t.can_run);
+
+    std::vector<Thread> workers(threads);
+    u32 started{};
+    ON_SCOPE_EXIT(
+        for (u32 i = 0; i < started; i++) {
+            threadWaitForExit(&workers[i]);
+            threadClose(&workers[i]);
+        }
+    );
+
+    const auto stop_workers = [&t](Result rc) {
+        SCOPED_MUTEX(&t.mutex);
+        if (R_SUCCEEDED(t.rc)) {
+            t.rc = rc;
+        }
+        condvarWakeAll(&t.can_run);
+    };
+
+    // on failure, the workers that already started are stopped rather than
+    // left to dump the remaining small files.
+    for (auto& thread : workers) {
+        if (const auto rc = threadCreate(&thread, SmallFilesThreadFunc, &t, nullptr, 1024*128, PRIO_PREEMPTIVE, -2); R_FAILED(rc)) {
+            stop_workers(rc);
+            R_THROW(rc);
+        }
+
+        if (const auto rc = threadStart(&thread); R_FAILED(rc)) {
+            threadClose(&thread);
+            stop_workers(rc);
+            R_THROW(rc);
+        }
+        started++;
+    }
+
+    for (const auto& path : large) {
+        if (const auto rc = on_large(path); R_FAILED(rc)) {
+            stop_workers(rc);
+            R_THROW(rc);
+        }
+    }
+
+    // show the progress of the remaining small files.
+    pbox->NewTransfer("Dumping small files"_i18n);
+
+    SCOPED_MUTEX(&t.mutex);
+    while (t.files_done < t.paths.size() && R_SUCCEEDED(t.rc)) {
+        pbox->UpdateTransfer(t.bytes_done, t.total_size);
+        condvarWait(&t.can_run, &t.mutex);
+    }
+
+    return t.rc;
+}
+
 Result DumpToFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& root, BaseSource* source, std::span<const fs::FsPath> paths) {
     const auto is_file_based_emummc = App::IsFileBaseEmummc();
+    // file based emummc stalls with too many writes in flight.
+    const u32 small_file_threads = is_file_based_emummc ? 1 : 2;
 
-    for (const auto& path : paths) {
+    const auto on_small = [&](const fs::FsPath& path, std::span<const u8> data) -> Result {
+        const auto base_path = fs::AppendPath(root, path);
+        const auto temp_path = base_path + ".temp";
+        fs->CreateDirectoryRecursivelyWithPath(temp_path);
+        fs->DeleteFile(temp_path);
+
+        R_TRY(fs->CreateFile(temp_path, data.size()));
+        ON_SCOPE_EXIT(fs->DeleteFile(temp_path));
+
+        if (!data.empty()) {
+            fs::File file;
+            R_TRY(fs->OpenFile(temp_path, FsOpenMode_Write, &file));
+            R_TRY(file.Write(0, data.data(), data.size(), FsWriteOption_None));
+        }
+
+        fs->DeleteFile(base_path);
+        return fs->RenameFile(temp_path, base_path);
+    };
+
+    const auto on_large = [&](const fs::FsPath& path) -> Result {
         const auto base_path = fs::AppendPath(root, path);
         const auto file_size = source->GetSize(path);
         pbox->SetImage(source->GetIcon(path));
@@ -129,15 +341,17 @@ Result DumpToFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& root, Bas
                         svcSleepThread(2e+6); // 2ms
                     }
                     return rc;
-                }
+                },
+                thread::Mode::MultiThreaded, thread::POLICY_BURSTY
             ));
         }
 
         fs->DeleteFile(base_path);
         R_TRY(fs->RenameFile(temp_path, base_path));
-    }
+        R_SUCCEED();
+    };
 
-    R_SUCCEED();
+    return DumpScheduled(pbox, source, paths, small_file_threads, on_small, on_large);
 }
 
 Result DumpToFileNative(ui::ProgressBox* pbox, BaseSource* source, std::span<const fs::FsPath> paths) {
@@ -173,7 +387,8 @@ Result DumpToUsbS2SStream(ui::ProgressBox* pbox, UsbTest* usb, std::span<const f
                 }
 
                 R_THROW(0xFFFF);
-            }
+            },
+            thread::Mode::MultiThreaded, thread::POLICY_BURSTY
         ));
     }
 
@@ -241,7 +456,11 @@ Result DumpToUsbS2S(ui::ProgressBox* pbox, BaseSource* source, std::span<const f
 }
 
 Result DumpToDevNull(ui::ProgressBox* pbox, BaseSource* source, std::span<const fs::FsPath> paths) {
-    for (auto path : paths) {
+    const auto on_small = [](const fs::FsPath& path, std::span<const u8> data) -> Result {
+        R_SUCCEED();
+    };
+
+    const auto on_large = [&](const fs::FsPath& path) -> Result {
         R_TRY(pbox->ShouldExitResult());
 
         const auto file_size = source->GetSize(path);
@@ -249,17 +468,18 @@ Result DumpToDevNull(ui::ProgressBox* pbox, BaseSource* source, std::span<const
         pbox->SetTitle(source->GetName(path));
         pbox->NewTransfer(path);
 
-        R_TRY(thread::Transfer(pbox, file_size,
+        return thread::Transfer(pbox, file_size,
             [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
                 return source->Read(path, data, off, size, bytes_read);
             },
             [&](const void* data, s64 off, s64 size) -> Result {
                 R_SUCCEED();
-            }
-        ));
-    }
+            },
+            thread::Mode::MultiThreaded, thread::POLICY_BURSTY
+        );
+    };
 
-    R_SUCCEED();
+    return DumpScheduled(pbox, source, paths, SMALL_FILE_MAX_THREADS, on_small, on_large);
 }
 
 Result DumpToNetwork(ui::ProgressBox* pbox, const location::Entry& loc, BaseSource* source, std::span<const fs::FsPath> paths) {
@@ -303,7 +523,8 @@ Result DumpToNetwork(ui::ProgressBox* pbox, const location::Entry& loc, BaseSour
 
                 R_UNLESS(result.success, Result_DumpFailedNetworkUpload);
                 R_SUCCEED();
-            }
+            },
+            thread::Mode::MultiThreaded, thread::POLICY_BURSTY
         ));
     }
 
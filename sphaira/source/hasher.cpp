@@ -55,12 +55,6 @@ private:
     const std::span<const u8> m_data;
 };
 
-struct HashSource {
-    virtual ~HashSource() = default;
-    virtual void Update(const void* buf, s64 size) = 0;
-    virtual void Get(std::string& out) = 0;
-};
-
 struct HashCrc32 final : HashSource {
     void Update(const void* buf, s64 size) override {
         m_seed = crc32CalculateWithSeed(m_seed, buf, size);
@@ -186,16 +180,20 @@ auto GetTypeStr(Type type) -> const char* {
     return "";
 }
 
-Result Hash(ui::ProgressBox* pbox, Type type, BaseSource* source, std::string& out) {
+auto Create(Type type) -> std::unique_ptr<HashSource> {
     switch (type) {
-        case Type::Crc32: return Hash(pbox, std::make_unique<HashCrc32>(), source, out);
-        case Type::Md5: return Hash(pbox, std::make_unique<HashMd5>(), source, out);
-        case Type::Sha1: return Hash(pbox, std::make_unique<HashSha1>(), source, out);
-        case Type::Sha256: return Hash(pbox, std::make_unique<HashSha256>(), source, out);
+        case Type::Crc32: return std::make_unique<HashCrc32>();
+        case Type::Md5: return std::make_unique<HashMd5>();
+        case Type::Sha1: return std::make_unique<HashSha1>();
+        case Type::Sha256: return std::make_unique<HashSha256>();
     }
     std::unreachable();
 }
 
+Result Hash(ui::ProgressBox* pbox, Type type, BaseSource* source, std::string& out) {
+    return Hash(pbox, Create(type), source, out);
+}
+
 Result Hash(ui::ProgressBox* pbox, Type type, fs::Fs* fs, const fs::FsPath& path, std::string& out) {
     auto source = std::make_unique<FileSource>(fs, path);
     return Hash(pbox, type, source.get(), out);
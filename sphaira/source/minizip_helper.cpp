@@ -1,8 +1,11 @@
 #include "minizip_helper.hpp"
+#include "defines.hpp"
+#include "log.hpp"
 #include <minizip/unzip.h>
 #include <minizip/zip.h>
 #include <cstring>
 #include <cstdio>
+#include <algorithm>
 
 namespace sphaira::mz {
 namespace {
@@ -191,6 +194,91 @@ constexpr zlib_filefunc64_def zlib_filefunc_stdio = {
     .zerror_file = minizip_error_file_func_stdio,
 };
 
+voidpf minizip_open_file_func_file(voidpf opaque, const void* filename, int mode) {
+    return opaque;
+}
+
+ZPOS64_T minizip_tell_file_func_file(voidpf opaque, voidpf stream) {
+    auto file = static_cast<const MzFile*>(opaque);
+    return file->Tell();
+}
+
+long minizip_seek_file_func_file(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin) {
+    auto file = static_cast<MzFile*>(opaque);
+    s64 new_offset = 0;
+
+    switch (origin) {
+        case ZLIB_FILEFUNC_SEEK_SET: new_offset = offset; break;
+        case ZLIB_FILEFUNC_SEEK_CUR: new_offset = file->Tell() + offset; break;
+        case ZLIB_FILEFUNC_SEEK_END: new_offset = file->Size() + offset; break;
+        default: return -1;
+    }
+
+    if (!file->Seek(new_offset)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+uLong minizip_read_file_func_file(voidpf opaque, voidpf stream, void* buf, uLong size) {
+    // only used for creating zips.
+    return 0;
+}
+
+uLong minizip_write_file_func_file(voidpf opaque, voidpf stream, const void* buf, uLong size) {
+    auto file = static_cast<MzFile*>(opaque);
+    return file->Write(buf, size);
+}
+
+int minizip_close_file_func_file(voidpf opaque, voidpf stream) {
+    auto file = static_cast<MzFile*>(opaque);
+    return R_SUCCEEDED(file->Close()) ? 0 : -1;
+}
+
+constexpr zlib_filefunc64_def zlib_filefunc_file = {
+    .zopen64_file = minizip_open_file_func_file,
+    .zread_file = minizip_read_file_func_file,
+    .zwrite_file = minizip_write_file_func_file,
+    .ztell64_file = minizip_tell_file_func_file,
+    .zseek64_file = minizip_seek_file_func_file,
+    .zclose_file = minizip_close_file_func_file,
+};
+
+constexpr u32 LOCAL_HEADER_MAGIC = 0x04034b50;
+constexpr u32 CENTRAL_HEADER_MAGIC = 0x02014b50;
+constexpr u32 END_OF_CENTRAL_MAGIC = 0x06054b50;
+constexpr u32 END_OF_CENTRAL64_MAGIC = 0x06064b50;
+constexpr u32 DESCRIPTOR_MAGIC = 0x08074b50;
+constexpr u32 LOCAL_HEADER_SIZE = 30;
+constexpr u16 ZIP64_EXTRA_ID = 0x0001;
+
+constexpr u16 FLAG_ENCRYPTED = 1 << 0;
+constexpr u16 FLAG_DESCRIPTOR = 1 << 3;
+
+constexpr u16 METHOD_STORE = 0;
+constexpr u16 METHOD_DEFLATE = 8;
+
+constexpr s64 STREAM_OUT_BUFFER_SIZE = 1024 * 512;
+
+auto Read16(const u8* p) -> u16 {
+    u16 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+auto Read32(const u8* p) -> u32 {
+    u32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+auto Read64(const u8* p) -> u64 {
+    u64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
 } // namespace
 
 void FileFuncMem(MzMem* mem, zlib_filefunc64_def* funcs) {
@@ -207,4 +295,540 @@ void FileFuncStdio(zlib_filefunc64_def* funcs) {
     *funcs = zlib_filefunc_stdio;
 }
 
+void FileFuncFile(MzFile* file, zlib_filefunc64_def* funcs) {
+    *funcs = zlib_filefunc_file;
+    funcs->opaque = file;
+}
+
+MzFile::MzFile(fs::File* file, s64 flush_size, u64 write_sleep_ns)
+: m_file{file}
+, m_flush_size{flush_size}
+, m_write_sleep_ns{write_sleep_ns} {
+    mutexInit(&m_mutex);
+    condvarInit(&m_can_flush);
+    condvarInit(&m_flushed);
+    m_buf.reserve(m_flush_size);
+
+    // if the thread fails to start, flushing falls back to writing directly.
+    if (R_SUCCEEDED(threadCreate(&m_thread, ThreadFunc, this, nullptr, 1024*32, PRIO_PREEMPTIVE, -2))) {
+        if (R_SUCCEEDED(threadStart(&m_thread))) {
+            m_thread_started = true;
+        } else {
+            threadClose(&m_thread);
+        }
+    }
+}
+
+MzFile::~MzFile() {
+    Close();
+}
+
+Result MzFile::Close() {
+    // the thread is still stopped below if the flush fails, the first
+    // error is returned.
+    Result rc{};
+    if (!m_buf.empty()) {
+        rc = Flush();
+    }
+
+    if (const auto flush_rc = WaitForFlush(); R_SUCCEEDED(rc)) {
+        rc = flush_rc;
+    }
+
+    if (m_thread_started) {
+        mutexLock(&m_mutex);
+        m_quit = true;
+        condvarWakeOne(&m_can_flush);
+        mutexUnlock(&m_mutex);
+
+        threadWaitForExit(&m_thread);
+        threadClose(&m_thread);
+        m_thread_started = false;
+    }
+
+    return rc;
+}
+
+auto MzFile::Seek(s64 offset) -> bool {
+    if (offset < 0 || offset > m_size) {
+        return false;
+    }
+
+    m_offset = offset;
+    return true;
+}
+
+auto MzFile::Write(const void* _data, s64 size) -> s64 {
+    auto data = static_cast<const u8*>(_data);
+    const auto total = size;
+
+    while (size > 0) {
+        if (m_offset < m_buf_offset) {
+            // already flushed, patch the file directly.
+            const auto write_size = std::min(size, m_buf_offset - m_offset);
+            if (R_FAILED(WaitForFlush()) || R_FAILED(m_file->Write(m_offset, data, write_size, FsWriteOption_None))) {
+                return 0;
+            }
+
+            data += write_size;
+            size -= write_size;
+            m_offset += write_size;
+            continue;
+        }
+
+        // buffer is full, hand it over to the thread.
+        const auto buf_off = m_offset - m_buf_offset;
+        if (buf_off >= m_flush_size) {
+            m_buf.resize(m_flush_size);
+            if (R_FAILED(Flush())) {
+                return 0;
+            }
+            continue;
+        }
+
+        const auto write_size = std::min(size, m_flush_size - buf_off);
+        if ((s64)m_buf.size() < buf_off + write_size) {
+            m_buf.resize(buf_off + write_size);
+        }
+
+        std::memcpy(m_buf.data() + buf_off, data, write_size);
+        data += write_size;
+        size -= write_size;
+        m_offset += write_size;
+        m_size = std::max(m_size, m_offset);
+    }
+
+    return total;
+}
+
+Result MzFile::Flush() {
+    R_TRY(WaitForFlush());
+
+    if (!m_thread_started) {
+        R_TRY(m_file->Write(m_buf_offset, m_buf.data(), m_buf.size(), FsWriteOption_None));
+        m_buf_offset += m_buf.size();
+        m_buf.clear();
+        R_SUCCEED();
+    }
+
+    SCOPED_MUTEX(&m_mutex);
+    std::swap(m_buf, m_flush_buf);
+    m_flush_offset = m_buf_offset;
+    m_buf_offset += m_flush_buf.size();
+    m_buf.clear();
+    m_buf.reserve(m_flush_size);
+
+    m_flush_pending = true;
+    condvarWakeOne(&m_can_flush);
+    R_SUCCEED();
+}
+
+Result MzFile::WaitForFlush() {
+    SCOPED_MUTEX(&m_mutex);
+    while (m_flush_pending) {
+        condvarWait(&m_flushed, &m_mutex);
+    }
+
+    return m_result;
+}
+
+void MzFile::ThreadFunc(void* arg) {
+    auto file = static_cast<MzFile*>(arg);
+
+    SCOPED_MUTEX(&file->m_mutex);
+    for (;;) {
+        while (!file->m_quit && !file->m_flush_pending) {
+            condvarWait(&file->m_can_flush, &file->m_mutex);
+        }
+
+        if (!file->m_flush_pending) {
+            break;
+        }
+
+        mutexUnlock(&file->m_mutex);
+        auto rc = file->m_file->Write(file->m_flush_offset, file->m_flush_buf.data(), file->m_flush_buf.size(), FsWriteOption_None);
+        if (file->m_write_sleep_ns) {
+            svcSleepThread(file->m_write_sleep_ns);
+        }
+        mutexLock(&file->m_mutex);
+
+        if (R_FAILED(rc) && R_SUCCEEDED(file->m_result)) {
+            file->m_result = rc;
+        }
+
+        file->m_flush_pending = false;
+        condvarWakeAll(&file->m_flushed);
+    }
+}
+
+StreamUnzip::StreamUnzip(fs::Fs* fs, const OnEntry& on_entry, const OnEntryDone& on_done)
+: m_fs{fs}
+, m_on_entry{on_entry}
+, m_on_done{on_done} {
+    m_header.reserve(LOCAL_HEADER_SIZE);
+}
+
+StreamUnzip::~StreamUnzip() {
+    if (m_z_init) {
+        inflateEnd(&m_z);
+    }
+}
+
+Result StreamUnzip::Push(const void* buf, s64 size) {
+    auto data = static_cast<const u8*>(buf);
+
+    while (size > 0 && m_state != State::Done) {
+        s64 used{};
+
+        if (m_state == State::Data) {
+            R_TRY(PushData(data, size, &used));
+        } else {
+            // collect header / descriptor bytes until there's enough to parse.
+            used = std::min<s64>(size, m_header_want - m_header.size());
+            m_header.insert(m_header.end(), data, data + used);
+
+            if (m_header.size() == m_header_want) {
+                if (m_state == State::Header) {
+                    R_TRY(ParseHeader());
+                } else {
+                    R_TRY(ParseDescriptor());
+                }
+            }
+        }
+
+        data += used;
+        size -= used;
+    }
+
+    R_SUCCEED();
+}
+
+Result StreamUnzip::Finish() {
+    // no central directory is fine, so long as every entry was completed.
+    R_UNLESS(m_state == State::Done || (m_state == State::Header && m_header.empty()), Result_UnzReadCurrentFile);
+    R_SUCCEED();
+}
+
+Result StreamUnzip::ParseHeader() {
+    const auto p = m_header.data();
+
+    // check the magic first, as the central directory follows the last entry.
+    if (m_header_want == 4) {
+        const auto magic = Read32(p);
+        if (magic == CENTRAL_HEADER_MAGIC || magic == END_OF_CENTRAL_MAGIC || magic == END_OF_CENTRAL64_MAGIC) {
+            m_state = State::Done;
+            R_SUCCEED();
+        }
+
+        if (magic != LOCAL_HEADER_MAGIC) {
+            log_write("[MZ] bad local header magic: 0x%08X\n", magic);
+            R_THROW(Result_UnzStreamUnsupported);
+        }
+
+        m_header_want = LOCAL_HEADER_SIZE;
+        R_SUCCEED();
+    }
+
+    const auto name_len = Read16(p + 26);
+    const auto extra_len = Read16(p + 28);
+
+    // fetch the name and extra field.
+    if (m_header_want == LOCAL_HEADER_SIZE && (name_len || extra_len)) {
+        m_header_want += name_len + extra_len;
+        R_SUCCEED();
+    }
+
+    m_flags = Read16(p + 6);
+    m_method = Read16(p + 8);
+    m_entry = {};
+    m_entry.crc32 = Read32(p + 14);
+    m_entry.compressed_size = Read32(p + 18);
+    m_entry.uncompressed_size = Read32(p + 22);
+
+    // zip64 stores the real sizes in the extra field.
+    m_zip64 = false;
+    const auto extra = p + LOCAL_HEADER_SIZE + name_len;
+    for (u32 off = 0; off + 4 <= extra_len;) {
+        const auto id = Read16(extra + off);
+        const auto len = Read16(extra + off + 2);
+        if (off + 4 + len > extra_len) {
+            break;
+        }
+
+        if (id == ZIP64_EXTRA_ID) {
+            m_zip64 = true;
+
+            u32 field = off + 4;
+            if (m_entry.uncompressed_size == 0xFFFFFFFF && field + 8 <= off + 4 + len) {
+                m_entry.uncompressed_size = Read64(extra + field);
+                field += 8;
+            }
+            if (m_entry.compressed_size == 0xFFFFFFFF && field + 8 <= off + 4 + len) {
+                m_entry.compressed_size = Read64(extra + field);
+            }
+        }
+
+        off += 4 + len;
+    }
+
+    if (m_flags & FLAG_ENCRYPTED) {
+        log_write("[MZ] encrypted entries are not supported\n");
+        R_THROW(Result_UnzStreamUnsupported);
+    }
+
+    if (m_method != METHOD_STORE && m_method != METHOD_DEFLATE) {
+        log_write("[MZ] unsupported compression method: %u\n", m_method);
+        R_THROW(Result_UnzStreamUnsupported);
+    }
+
+    // stored entries with a descriptor have no way of knowing where they end.
+    if (m_method == METHOD_STORE && (m_flags & FLAG_DESCRIPTOR)) {
+        log_write("[MZ] stored entry with data descriptor\n");
+        R_THROW(Result_UnzStreamUnsupported);
+    }
+
+    if (!(m_flags & FLAG_DESCRIPTOR) && (m_entry.compressed_size == 0xFFFFFFFF || m_entry.uncompressed_size == 0xFFFFFFFF)) {
+        log_write("[MZ] missing zip64 extra field\n");
+        R_THROW(Result_UnzStreamUnsupported);
+    }
+
+    if (name_len >= sizeof(m_entry.name)) {
+        log_write("[MZ] name too long: %u\n", name_len);
+        R_THROW(Result_UnzStreamUnsupported);
+    }
+
+    std::memcpy(m_entry.name.s, p + LOCAL_HEADER_SIZE, name_len);
+    m_entry.name[name_len] = '\0';
+
+    if (m_flags & FLAG_DESCRIPTOR) {
+        m_entry.crc32 = 0;
+        m_entry.compressed_size = 0;
+        m_entry.uncompressed_size = 0;
+    }
+
+    m_header.clear();
+    return BeginEntry();
+}
+
+Result StreamUnzip::ParseDescriptor() {
+    // crc32, compressed and uncompressed size.
+    const u64 desc_size = m_zip64 ? 4 + 8 + 8 : 4 + 4 + 4;
+    const auto p = m_header.data();
+
+    // the signature is optional.
+    if (m_header_want == 4) {
+        if (Read32(p) == DESCRIPTOR_MAGIC) {
+            m_header.clear();
+        }
+
+        m_header_want = desc_size;
+        R_SUCCEED();
+    }
+
+    m_entry.crc32 = Read32(p);
+    if (m_zip64) {
+        m_entry.compressed_size = Read64(p + 4);
+        m_entry.uncompressed_size = Read64(p + 12);
+    } else {
+        m_entry.compressed_size = Read32(p + 4);
+        m_entry.uncompressed_size = Read32(p + 8);
+    }
+
+    return EndEntry();
+}
+
+Result StreamUnzip::BeginEntry() {
+    m_path = {};
+    m_crc32 = 0;
+    m_out_offset = 0;
+    m_file_offset = 0;
+    m_data_left = m_entry.compressed_size;
+    m_state = State::Data;
+
+    // folders are created when the files inside of them are extracted.
+    const auto name_len = std::strlen(m_entry.name);
+    if (name_len && m_entry.name[name_len - 1] != '/') {
+        R_TRY(m_on_entry(m_entry, m_path));
+    }
+
+    if (!m_path.empty()) {
+        Result rc;
+        if (R_FAILED(rc = m_fs->CreateDirectoryRecursivelyWithPath(m_path)) && rc != FsError_PathAlreadyExists) {
+            log_write("[MZ] failed to create folder: %s 0x%04X\n", m_path.s, rc);
+            R_THROW(rc);
+        }
+
+        if (R_FAILED(rc = m_fs->CreateFile(m_path, m_entry.uncompressed_size, 0)) && rc != FsError_PathAlreadyExists) {
+            log_write("[MZ] failed to create file: %s 0x%04X\n", m_path.s, rc);
+            R_THROW(rc);
+        }
+
+        R_TRY(m_fs->OpenFile(m_path, FsOpenMode_Write|FsOpenMode_Append, &m_file));
+
+        // only update the size if this is an existing file.
+        if (rc == FsError_PathAlreadyExists) {
+            R_TRY(m_file.SetSize(m_entry.uncompressed_size));
+        }
+    }
+
+    if (m_out.empty()) {
+        m_out.resize(STREAM_OUT_BUFFER_SIZE);
+    }
+
+    if (m_method == METHOD_DEFLATE) {
+        if (!m_z_init) {
+            R_UNLESS(Z_OK == inflateInit2(&m_z, -MAX_WBITS), Result_UnzOpenCurrentFile);
+            m_z_init = true;
+        } else {
+            R_UNLESS(Z_OK == inflateReset(&m_z), Result_UnzOpenCurrentFile);
+        }
+    }
+
+    // empty entries have no data to read.
+    if (!(m_flags & FLAG_DESCRIPTOR) && !m_data_left) {
+        return EndData();
+    }
+
+    R_SUCCEED();
+}
+
+Result StreamUnzip::PushData(const u8* data, s64 size, s64* used) {
+    const auto has_descriptor = m_flags & FLAG_DESCRIPTOR;
+
+    // without a descriptor the size is known, otherwise the deflate stream marks the end.
+    if (!has_descriptor) {
+        size = std::min(size, m_data_left);
+    }
+
+    bool stream_end{};
+    if (m_method == METHOD_STORE) {
+        R_TRY(WriteOut(data, size));
+        *used = size;
+    } else {
+        m_z.next_in = const_cast<Bytef*>(data);
+        m_z.avail_in = std::min<s64>(size, UINT32_MAX);
+
+        // keep going whilst there's input, or whilst the output was filled
+        // as inflate may still have pending output.
+        do {
+            if (m_out_offset == (s64)m_out.size()) {
+                R_TRY(FlushOut());
+            }
+
+            const auto avail = m_out.size() - m_out_offset;
+            m_z.next_out = m_out.data() + m_out_offset;
+            m_z.avail_out = avail;
+
+            const auto zr = inflate(&m_z, Z_NO_FLUSH);
+            if (zr == Z_BUF_ERROR && !m_z.avail_in) {
+                // needs more input.
+                break;
+            } else if (zr != Z_OK && zr != Z_STREAM_END) {
+                log_write("[MZ] failed to inflate: %s %d\n", m_entry.name.s, zr);
+                R_THROW(Result_UnzReadCurrentFile);
+            }
+
+            const auto produced = avail - m_z.avail_out;
+            if (!m_path.empty()) {
+                m_crc32 = crc32CalculateWithSeed(m_crc32, m_out.data() + m_out_offset, produced);
+            }
+
+            m_out_offset += produced;
+            stream_end = zr == Z_STREAM_END;
+        } while (!stream_end && (m_z.avail_in || !m_z.avail_out));
+
+        *used = size - m_z.avail_in;
+    }
+
+    if (!has_descriptor) {
+        m_data_left -= *used;
+
+        // the deflate stream must end exactly at the end of the entry.
+        if (m_method == METHOD_DEFLATE && stream_end != !m_data_left) {
+            log_write("[MZ] deflate size mismatch: %s\n", m_entry.name.s);
+            R_THROW(Result_UnzReadCurrentFile);
+        }
+
+        if (!m_data_left) {
+            return EndData();
+        }
+    } else if (stream_end) {
+        return EndData();
+    }
+
+    R_SUCCEED();
+}
+
+Result StreamUnzip::EndData() {
+    R_TRY(FlushOut());
+
+    if (m_flags & FLAG_DESCRIPTOR) {
+        m_state = State::Descriptor;
+        m_header.clear();
+        m_header_want = 4;
+        R_SUCCEED();
+    }
+
+    return EndEntry();
+}
+
+Result StreamUnzip::EndEntry() {
+    m_state = State::Header;
+    m_header.clear();
+    m_header_want = 4;
+
+    if (m_path.empty()) {
+        R_SUCCEED();
+    }
+
+    // the final size is only known here when using a data descriptor.
+    if (m_flags & FLAG_DESCRIPTOR) {
+        R_TRY(m_file.SetSize(m_entry.uncompressed_size));
+    }
+    m_file.Close();
+
+    if (m_crc32 != m_entry.crc32) {
+        log_write("[MZ] bad crc32: %s 0x%08X vs 0x%08X\n", m_path.s, m_crc32, m_entry.crc32);
+        R_THROW(Result_UnzStreamBadCrc32);
+    }
+
+    if (m_on_done) {
+        R_TRY(m_on_done(m_entry, m_path));
+    }
+
+    R_SUCCEED();
+}
+
+Result StreamUnzip::WriteOut(const u8* data, s64 size) {
+    if (m_path.empty()) {
+        R_SUCCEED();
+    }
+
+    m_crc32 = crc32CalculateWithSeed(m_crc32, data, size);
+
+    while (size > 0) {
+        if (m_out_offset == (s64)m_out.size()) {
+            R_TRY(FlushOut());
+        }
+
+        const auto copy = std::min<s64>(size, m_out.size() - m_out_offset);
+        std::memcpy(m_out.data() + m_out_offset, data, copy);
+        m_out_offset += copy;
+        data += copy;
+        size -= copy;
+    }
+
+    R_SUCCEED();
+}
+
+Result StreamUnzip::FlushOut() {
+    if (!m_path.empty() && m_out_offset) {
+        R_TRY(m_file.Write(m_file_offset, m_out.data(), m_out_offset, FsWriteOption_None));
+        m_file_offset += m_out_offset;
+    }
+
+    m_out_offset = 0;
+    R_SUCCEED();
+}
+
 } // namespace sphaira::mz
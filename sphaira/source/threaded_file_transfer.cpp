@@ -3,9 +3,12 @@
 #include "defines.hpp"
 #include "app.hpp"
 #include "minizip_helper.hpp"
+#include "ring_buf.hpp"
 
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <span>
 #include <cstring>
 #include <minizip/unzip.h>
 #include <minizip/zip.h>
@@ -18,60 +21,42 @@ constexpr u64 SMALL_BUFFER_SIZE = 1024 * 512;
 // used for everything else.
 constexpr u64 NORMAL_BUFFER_SIZE = 1024*1024*4;
 
+// applet mode has far less memory, so the queue depth of a policy is capped
+// to the old double buffered depth.
+constexpr u32 APPLET_MAX_QUEUE_DEPTH = 2;
+
+// how long each chunk should take to read / write when using an adaptive policy.
+// large enough to amortise the per call overhead, small enough that the
+// writer is fed often when the source stalls.
+constexpr u64 ADAPTIVE_TARGET_NS = 16'000'000;
+// chunk sizes are rounded down to this.
+constexpr u64 ADAPTIVE_ALIGN = 1024 * 64;
+
+// entries smaller than this are extracted in parallel, each worker inflating a whole
+// entry at a time. larger entries use TransferUnzip(), which already splits
+// inflating and writing across cores.
+constexpr s64 PARALLEL_UNZIP_MAX_SIZE = 1024 * 1024 * 2;
+constexpr u32 PARALLEL_UNZIP_THREADS = 3;
+
+// files at least this size are deflated in parallel, split into chunks.
+constexpr s64 PARALLEL_ZIP_MIN_SIZE = 1024 * 1024 * 2;
+constexpr s64 PARALLEL_ZIP_CHUNK_SIZE = 1024 * 1024;
+// deflate window size, used as the dictionary for the next chunk.
+constexpr s64 PARALLEL_ZIP_DICT_SIZE = 1024 * 32;
+constexpr u32 PARALLEL_ZIP_THREADS = 3;
+// max number of chunks in flight, must be a power of 2.
+constexpr u32 PARALLEL_ZIP_JOBS = 4;
+
+static_assert((PARALLEL_ZIP_JOBS & (PARALLEL_ZIP_JOBS - 1)) == 0, "Must be power of 2!");
+
+// buffers are allocated on first use, so only the buffers in flight use memory.
 struct ThreadBuffer {
-    ThreadBuffer() {
-        buf.reserve(NORMAL_BUFFER_SIZE);
-    }
-
     std::vector<u8> buf;
     s64 off;
 };
 
-template<std::size_t Size>
-struct RingBuf {
-private:
-    ThreadBuffer buf[Size]{};
-    unsigned r_index{};
-    unsigned w_index{};
-
-    static_assert((sizeof(RingBuf::buf) & (sizeof(RingBuf::buf) - 1)) == 0, "Must be power of 2!");
-
-public:
-    void ringbuf_reset() {
-        this->r_index = this->w_index;
-    }
-
-    unsigned ringbuf_capacity() const {
-        return sizeof(this->buf) / sizeof(this->buf[0]);
-    }
-
-    unsigned ringbuf_size() const {
-        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
-    }
-
-    unsigned ringbuf_free() const {
-        return ringbuf_capacity() - ringbuf_size();
-    }
-
-    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
-        auto& value = this->buf[this->w_index % ringbuf_capacity()];
-        value.off = off_in;
-        std::swap(value.buf, buf_in);
-
-        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
-    }
-
-    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
-        auto& value = this->buf[this->r_index % ringbuf_capacity()];
-        off_out = value.off;
-        std::swap(value.buf, buf_out);
-
-        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
-    }
-};
-
 struct ThreadData {
-    ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size);
+    ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size, const Policy& _policy);
 
     auto GetResults() -> Result;
     void WakeAllThreads();
@@ -107,6 +92,7 @@ private:
     Result GetPullBuf(void* data, s64 size, u64* bytes_read);
 
     Result Read(void* buf, s64 size, u64* bytes_read);
+    void UpdateChunkSize(u64 read_ns, u64 read_size);
 
 private:
     // these need to be copied
@@ -115,21 +101,25 @@ private:
     const WriteCallback wfunc;
 
     // these need to be created
-    Mutex mutex{};
     Mutex pull_mutex{};
 
-    CondVar can_read{};
-    CondVar can_write{};
     CondVar can_pull{};
     CondVar can_pull_write{};
 
-    RingBuf<2> write_buffers{};
+    RingBuf<ThreadBuffer, MAX_QUEUE_DEPTH> write_buffers{};
     std::vector<u8> pull_buffer{};
     s64 pull_buffer_offset{};
 
-    const u64 read_buffer_size;
+    const Policy policy;
     const s64 write_size;
 
+    // only modified by the read thread.
+    u64 read_buffer_size;
+
+    // running average of how long writing each byte takes, in ns * 1024.
+    // set by the write thread and used by the read thread for adaptive sizing.
+    volatile u64 write_ns_per_kib{};
+
     // these are shared between threads
     volatile s64 read_offset{};
     volatile s64 write_offset{};
@@ -139,17 +129,16 @@ private:
     volatile Result pull_result{};
 };
 
-ThreadData::ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size)
+ThreadData::ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size, const Policy& _policy)
 : pbox{_pbox}
 , rfunc{_rfunc}
 , wfunc{_wfunc}
-, read_buffer_size{buffer_size}
-, write_size{size} {
-    mutexInit(std::addressof(mutex));
+, policy{_policy}
+, write_size{size}
+, read_buffer_size{buffer_size} {
+    write_buffers.SetDepth(App::IsApplet() ? std::min(policy.depth, APPLET_MAX_QUEUE_DEPTH) : policy.depth);
     mutexInit(std::addressof(pull_mutex));
 
-    condvarInit(std::addressof(can_read));
-    condvarInit(std::addressof(can_write));
     condvarInit(std::addressof(can_pull));
     condvarInit(std::addressof(can_pull_write));
 }
@@ -163,39 +152,33 @@ auto ThreadData::GetResults() -> Result {
 }
 
 void ThreadData::WakeAllThreads() {
-    condvarWakeAll(std::addressof(can_read));
-    condvarWakeAll(std::addressof(can_write));
+    write_buffers.WakeAll();
     condvarWakeAll(std::addressof(can_pull));
     condvarWakeAll(std::addressof(can_pull_write));
 
-    mutexUnlock(std::addressof(mutex));
     mutexUnlock(std::addressof(pull_mutex));
 }
 
 Result ThreadData::SetWriteBuf(std::vector<u8>& buf, s64 size) {
     buf.resize(size);
 
-    mutexLock(std::addressof(mutex));
-    if (!write_buffers.ringbuf_free()) {
-        R_TRY(condvarWait(std::addressof(can_read), std::addressof(mutex)));
-    }
-
-    ON_SCOPE_EXIT(mutexUnlock(std::addressof(mutex)));
-    R_TRY(GetResults());
-    write_buffers.ringbuf_push(buf, 0);
-    return condvarWakeOne(std::addressof(can_write));
+    return write_buffers.Push([&](ThreadBuffer& e) {
+        std::swap(e.buf, buf);
+        e.off = 0;
+    }, [this]() {
+        return GetResults();
+    });
 }
 
 Result ThreadData::GetWriteBuf(std::vector<u8>& buf_out, s64& off_out) {
-    mutexLock(std::addressof(mutex));
-    if (!write_buffers.ringbuf_size()) {
-        R_TRY(condvarWait(std::addressof(can_write), std::addressof(mutex)));
-    }
-
-    ON_SCOPE_EXIT(mutexUnlock(std::addressof(mutex)));
-    R_TRY(GetResults());
-    write_buffers.ringbuf_pop(buf_out, off_out);
-    return condvarWakeOne(std::addressof(can_read));
+    R_TRY(write_buffers.Pop([&](ThreadBuffer& e) {
+        std::swap(e.buf, buf_out);
+        off_out = e.off;
+    }, [this]() {
+        return GetResults();
+    }));
+
+    return GetResults();
 }
 
 Result ThreadData::SetPullBuf(std::vector<u8>& buf, s64 size) {
@@ -242,6 +225,27 @@ Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
     return rc;
 }
 
+// sizes the next chunk so that reading or writing it (whichever is slower)
+// takes roughly ADAPTIVE_TARGET_NS, changing by at most 2x each time.
+void ThreadData::UpdateChunkSize(u64 read_ns, u64 read_size) {
+    if (!policy.adaptive || !read_size) {
+        return;
+    }
+
+    const auto read_ns_per_kib = read_ns * 1024 / read_size;
+    const auto ns_per_kib = std::max<u64>(std::max<u64>(read_ns_per_kib, write_ns_per_kib), 1);
+
+    auto chunk_size = ADAPTIVE_TARGET_NS * 1024 / ns_per_kib;
+    chunk_size = std::clamp<u64>(chunk_size, read_buffer_size / 2, read_buffer_size * 2);
+    chunk_size = std::clamp<u64>(chunk_size, policy.min_chunk_size, policy.max_chunk_size);
+    chunk_size = std::max<u64>(chunk_size / ADAPTIVE_ALIGN * ADAPTIVE_ALIGN, ADAPTIVE_ALIGN);
+
+    if (chunk_size != read_buffer_size) {
+        log_write("[THREAD] adaptive chunk size: %zu -> %zu\n", read_buffer_size, chunk_size);
+        read_buffer_size = chunk_size;
+    }
+}
+
 Result ThreadData::Pull(void* data, s64 size, u64* bytes_read) {
     return GetPullBuf(data, size, bytes_read);
 }
@@ -258,7 +262,10 @@ Result ThreadData::readFuncInternal() {
 
         u64 bytes_read{};
         buf.resize(read_size);
+
+        const auto start = armGetSystemTick();
         R_TRY(this->Read(buf.data(), read_size, std::addressof(bytes_read)));
+        this->UpdateChunkSize(armTicksToNs(armGetSystemTick() - start), bytes_read);
         auto buf_size = bytes_read;
 
         R_TRY(this->SetWriteBuf(buf, buf_size));
@@ -278,12 +285,19 @@ Result ThreadData::writeFuncInternal() {
         R_TRY(this->GetWriteBuf(buf, dummy_off));
         const auto size = buf.size();
 
+        const auto start = armGetSystemTick();
         if (!this->wfunc) {
             R_TRY(this->SetPullBuf(buf, buf.size()));
         } else {
             R_TRY(this->wfunc(buf.data(), this->write_offset, buf.size()));
         }
 
+        if (this->policy.adaptive && size) {
+            const auto ns_per_kib = armTicksToNs(armGetSystemTick() - start) * 1024 / size;
+            // weight the latest write at 1/4 to smooth out spikes.
+            this->write_ns_per_kib = this->write_ns_per_kib ? (this->write_ns_per_kib * 3 + ns_per_kib) / 4 : ns_per_kib;
+        }
+
         this->write_offset += size;
     }
 
@@ -307,11 +321,22 @@ auto GetAlternateCore(int id) {
     return id == 1 ? 2 : 1;
 }
 
-Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, StartCallback2 sfunc, Mode mode, u64 buffer_size = NORMAL_BUFFER_SIZE) {
+Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, StartCallback2 sfunc, Mode mode, Policy policy, u64 buffer_size = NORMAL_BUFFER_SIZE) {
     const auto is_file_based_emummc = App::IsFileBaseEmummc();
 
+    if (policy.chunk_size) {
+        buffer_size = policy.chunk_size;
+    }
+
+    if (policy.adaptive) {
+        policy.min_chunk_size = std::min(policy.min_chunk_size, policy.max_chunk_size);
+        buffer_size = std::clamp(buffer_size, policy.min_chunk_size, policy.max_chunk_size);
+    }
+
+    // keep writes small and fixed to avoid stalling file based emummc.
     if (is_file_based_emummc) {
         buffer_size = SMALL_BUFFER_SIZE;
+        policy.adaptive = false;
     }
 
     if (mode == Mode::SingleThreadedIfSmaller) {
@@ -348,7 +373,7 @@ Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, Wri
         const auto WRITE_THREAD_CORE = sfunc ? pbox->GetCpuId() : GetAlternateCore(pbox->GetCpuId());
         const auto READ_THREAD_CORE = GetAlternateCore(WRITE_THREAD_CORE);
 
-        ThreadData t_data{pbox, size, rfunc, wfunc, buffer_size};
+        ThreadData t_data{pbox, size, rfunc, wfunc, buffer_size, policy};
 
         Thread t_read{};
         R_TRY(threadCreate(&t_read, readFunc, std::addressof(t_data), nullptr, 1024*256, 0x3B, READ_THREAD_CORE));
@@ -413,24 +438,396 @@ Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, Wri
     }
 }
 
+// chunks are deflated independently, non-final chunks end with a sync flush
+// so that they end on a byte boundary and can be joined into a single stream.
+struct DeflateJob {
+    Result Run(int level) {
+        z_stream z{};
+        R_UNLESS(Z_OK == deflateInit2(&z, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY), Result_ZipWriteInFileInZip);
+        ON_SCOPE_EXIT(deflateEnd(&z));
+
+        if (!dict.empty()) {
+            R_UNLESS(Z_OK == deflateSetDictionary(&z, dict.data(), dict.size()), Result_ZipWriteInFileInZip);
+        }
+
+        // the bound doesn't include the sync flush marker.
+        out.resize(deflateBound(&z, in.size()) + 16);
+
+        z.next_in = in.data();
+        z.avail_in = in.size();
+        z.next_out = out.data();
+        z.avail_out = out.size();
+
+        const auto zr = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (last ? zr != Z_STREAM_END : (zr != Z_OK || !z.avail_out)) {
+            log_write("[ZIP] failed to deflate chunk: %d\n", zr);
+            R_THROW(Result_ZipWriteInFileInZip);
+        }
+
+        out.resize(out.size() - z.avail_out);
+        R_SUCCEED();
+    }
+
+    std::vector<u8> in{};
+    std::vector<u8> dict{};
+    std::vector<u8> out{};
+    Result result{};
+    bool last{};
+    bool done{};
+};
+
+struct DeflatePool {
+    DeflatePool() {
+        mutexInit(std::addressof(mutex));
+        condvarInit(std::addressof(can_work));
+        condvarInit(std::addressof(can_pop));
+    }
+
+    ~DeflatePool() {
+        Close();
+    }
+
+    Result Create(int _level) {
+        level = _level;
+
+        for (u32 i = 0; i < PARALLEL_ZIP_THREADS; i++) {
+            auto thread = std::addressof(threads[thread_count]);
+            R_TRY(threadCreate(thread, WorkerFunc, this, nullptr, 1024*64, PRIO_PREEMPTIVE, i));
+
+            if (const auto rc = threadStart(thread); R_FAILED(rc)) {
+                threadClose(thread);
+                R_THROW(rc);
+            }
+
+            thread_count++;
+        }
+
+        R_SUCCEED();
+    }
+
+    void Close() {
+        mutexLock(std::addressof(mutex));
+        quit = true;
+        condvarWakeAll(std::addressof(can_work));
+        mutexUnlock(std::addressof(mutex));
+
+        for (u32 i = 0; i < thread_count; i++) {
+            threadWaitForExit(std::addressof(threads[i]));
+            threadClose(std::addressof(threads[i]));
+        }
+
+        thread_count = 0;
+    }
+
+    auto IsEmpty() const -> bool {
+        return submit_index == pop_index;
+    }
+
+    auto IsFull() const -> bool {
+        return submit_index - pop_index == PARALLEL_ZIP_JOBS;
+    }
+
+    // the pool must not be full, the buffers are swapped with unused buffers.
+    void Submit(std::vector<u8>& in, std::vector<u8>& dict, bool last) {
+        SCOPED_MUTEX(std::addressof(mutex));
+
+        auto& job = jobs[submit_index % PARALLEL_ZIP_JOBS];
+        std::swap(job.in, in);
+        std::swap(job.dict, dict);
+        job.last = last;
+        job.result = 0;
+        job.done = false;
+
+        submit_index++;
+        condvarWakeOne(std::addressof(can_work));
+    }
+
+    // blocks until the oldest chunk has finished, the output buffer is swapped.
+    Result Pop(std::vector<u8>& out) {
+        SCOPED_MUTEX(std::addressof(mutex));
+
+        auto& job = jobs[pop_index % PARALLEL_ZIP_JOBS];
+        while (!job.done) {
+            condvarWait(std::addressof(can_pop), std::addressof(mutex));
+        }
+
+        pop_index++;
+        std::swap(job.out, out);
+        return job.result;
+    }
+
+private:
+    static void WorkerFunc(void* d) {
+        auto pool = static_cast<DeflatePool*>(d);
+
+        SCOPED_MUTEX(std::addressof(pool->mutex));
+        for (;;) {
+            while (!pool->quit && pool->work_index == pool->submit_index) {
+                condvarWait(std::addressof(pool->can_work), std::addressof(pool->mutex));
+            }
+
+            if (pool->quit) {
+                break;
+            }
+
+            auto& job = pool->jobs[pool->work_index++ % PARALLEL_ZIP_JOBS];
+
+            mutexUnlock(std::addressof(pool->mutex));
+            const auto rc = job.Run(pool->level);
+            mutexLock(std::addressof(pool->mutex));
+
+            job.result = rc;
+            job.done = true;
+            condvarWakeAll(std::addressof(pool->can_pop));
+        }
+    }
+
+private:
+    Mutex mutex{};
+    CondVar can_work{};
+    CondVar can_pop{};
+
+    DeflateJob jobs[PARALLEL_ZIP_JOBS]{};
+    u32 submit_index{};
+    u32 work_index{};
+    u32 pop_index{};
+
+    Thread threads[PARALLEL_ZIP_THREADS]{};
+    u32 thread_count{};
+    int level{};
+    bool quit{};
+};
+
+// the file must already be opened in the zip in raw mode.
+Result ParallelZipRaw(ui::ProgressBox* pbox, void* zfile, fs::File& f, s64 file_size, int level, u32* crc32_out) {
+    DeflatePool pool;
+    R_TRY(pool.Create(level));
+
+    std::vector<u8> in, dict, out;
+    u32 crc32{};
+    s64 offset{};
+
+    const auto pop_and_write = [&]() -> Result {
+        R_TRY(pool.Pop(out));
+        if (ZIP_OK != zipWriteInFileInZip(zfile, out.data(), out.size())) {
+            R_THROW(Result_ZipWriteInFileInZip);
+        }
+        R_SUCCEED();
+    };
+
+    while (offset < file_size) {
+        R_TRY(pbox->ShouldExitResult());
+
+        if (pool.IsFull()) {
+            R_TRY(pop_and_write());
+        }
+
+        in.resize(std::min(PARALLEL_ZIP_CHUNK_SIZE, file_size - offset));
+        for (u64 off = 0; off < in.size();) {
+            u64 bytes_read;
+            R_TRY(f.Read(offset + off, in.data() + off, in.size() - off, FsReadOption_None, &bytes_read));
+            R_UNLESS(bytes_read, Result_ZipWriteInFileInZip);
+            off += bytes_read;
+        }
+
+        crc32 = crc32CalculateWithSeed(crc32, in.data(), in.size());
+        offset += in.size();
+
+        // save the tail of this chunk as the dictionary for the next one.
+        std::vector<u8> next_dict;
+        const auto dict_size = std::min<s64>(PARALLEL_ZIP_DICT_SIZE, in.size());
+        next_dict.assign(in.end() - dict_size, in.end());
+
+        pool.Submit(in, dict, offset == file_size);
+        dict = std::move(next_dict);
+
+        pbox->UpdateTransfer(offset, file_size);
+    }
+
+    while (!pool.IsEmpty()) {
+        R_TRY(pop_and_write());
+    }
+
+    *crc32_out = crc32;
+    R_SUCCEED();
+}
+
+struct UnzipEntry {
+    fs::FsPath path;
+    unz64_file_pos pos;
+    s64 size;
+    u32 crc32;
+};
+
+// workers each open their own handle to the zip and take the next entry from a
+// shared index, so entries are still read (mostly) in order.
+struct ParallelUnzip {
+    ParallelUnzip(const fs::FsPath& _zip_path, fs::Fs* _fs, std::span<const UnzipEntry> _entries)
+    : zip_path{_zip_path}, fs{_fs}, entries{_entries} {}
+
+    void SetResult(Result rc) {
+        Result expected{};
+        result.compare_exchange_strong(expected, rc);
+    }
+
+    const fs::FsPath& zip_path;
+    fs::Fs* const fs;
+    const std::span<const UnzipEntry> entries;
+
+    std::atomic<u32> next_entry{};
+    std::atomic<u32> done_count{};
+    std::atomic<s64> done_bytes{};
+    std::atomic<Result> result{};
+};
+
+Result ParallelUnzipInternal(ParallelUnzip* t) {
+    zlib_filefunc64_def file_func;
+    mz::FileFuncStdio(&file_func);
+
+    auto zfile = unzOpen2_64(t->zip_path, &file_func);
+    R_UNLESS(zfile, Result_UnzOpen2_64);
+    ON_SCOPE_EXIT(unzClose(zfile));
+
+    std::vector<u8> buf;
+    while (R_SUCCEEDED(t->result.load())) {
+        const auto index = t->next_entry++;
+        if (index >= t->entries.size()) {
+            break;
+        }
+
+        const auto& e = t->entries[index];
+        if (UNZ_OK != unzGoToFilePos64(zfile, &e.pos)) {
+            log_write("failed to go to file pos: %s\n", e.path.s);
+            R_THROW(Result_UnzGoToNextFile);
+        }
+
+        if (UNZ_OK != unzOpenCurrentFile(zfile)) {
+            log_write("failed to open current file: %s\n", e.path.s);
+            R_THROW(Result_UnzOpenCurrentFile);
+        }
+        ON_SCOPE_EXIT(unzCloseCurrentFile(zfile));
+
+        buf.resize(e.size);
+        for (s64 off = 0; off < e.size;) {
+            const auto result = unzReadCurrentFile(zfile, buf.data() + off, e.size - off);
+            if (result <= 0) {
+                log_write("failed to read zip file: %s %d\n", e.path.s, result);
+                R_THROW(Result_UnzReadCurrentFile);
+            }
+            off += result;
+        }
+
+        // validate crc32 (if set in the info).
+        R_UNLESS(!e.crc32 || e.crc32 == crc32CalculateWithSeed(0, buf.data(), buf.size()), 0x8);
+
+        // the folder was already created by the caller.
+        Result rc;
+        if (R_FAILED(rc = t->fs->CreateFile(e.path, e.size, 0)) && rc != FsError_PathAlreadyExists) {
+            log_write("failed to create file: %s 0x%04X\n", e.path.s, rc);
+            R_THROW(rc);
+        }
+
+        fs::File f;
+        R_TRY(t->fs->OpenFile(e.path, FsOpenMode_Write, &f));
+
+        // only update the size if this is an existing file.
+        if (rc == FsError_PathAlreadyExists) {
+            R_TRY(f.SetSize(e.size));
+        }
+
+        if (e.size) {
+            R_TRY(f.Write(0, buf.data(), buf.size(), FsWriteOption_None));
+        }
+
+        t->done_bytes += e.size;
+        t->done_count++;
+    }
+
+    R_SUCCEED();
+}
+
+void ParallelUnzipFunc(void* arg) {
+    auto t = static_cast<ParallelUnzip*>(arg);
+    t->SetResult(ParallelUnzipInternal(t));
+}
+
+Result ParallelUnzipEntries(ui::ProgressBox* pbox, const fs::FsPath& zip_path, fs::Fs* fs, std::span<const UnzipEntry> entries) {
+    if (entries.empty()) {
+        R_SUCCEED();
+    }
+
+    s64 total_bytes{};
+    for (const auto& e : entries) {
+        total_bytes += e.size;
+    }
+
+    ParallelUnzip t_data{zip_path, fs, entries};
+    const auto thread_count = std::min<u32>(PARALLEL_UNZIP_THREADS, entries.size());
+
+    Thread threads[PARALLEL_UNZIP_THREADS]{};
+    u32 started{};
+
+    const auto close_threads = [&]() {
+        for (u32 i = 0; i < started; i++) {
+            threadWaitForExit(&threads[i]);
+            threadClose(&threads[i]);
+        }
+        started = 0;
+    };
+    ON_SCOPE_EXIT(close_threads());
+
+    for (u32 i = 0; i < thread_count; i++) {
+        // stop the workers that already started rather than waiting for them
+        // to extract the remaining entries.
+        if (const auto rc = threadCreate(&threads[i], ParallelUnzipFunc, std::addressof(t_data), nullptr, 1024*128, 0x3B, i); R_FAILED(rc)) {
+            t_data.SetResult(rc);
+            break;
+        }
+
+        if (R_FAILED(threadStart(&threads[i]))) {
+            threadClose(&threads[i]);
+            t_data.SetResult(Result_TransferCancelled);
+            break;
+        }
+
+        started++;
+    }
+
+    pbox->NewTransfer(zip_path);
+    while (t_data.done_count.load() != entries.size() && R_SUCCEEDED(t_data.result.load())) {
+        if (pbox->ShouldExit()) {
+            t_data.SetResult(pbox->ShouldExitResult());
+            break;
+        }
+
+        pbox->UpdateTransfer(t_data.done_bytes.load(), total_bytes);
+        svcSleepThread(1e+6);
+    }
+
+    close_threads();
+
+    log_write("[UNZIP] extracted %u entries in parallel\n", t_data.done_count.load());
+    return t_data.result.load();
+}
+
 } // namespace
 
-Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, Mode mode) {
-    return TransferInternal(pbox, size, rfunc, wfunc, nullptr, mode);
+Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, Mode mode, const Policy& policy) {
+    return TransferInternal(pbox, size, rfunc, wfunc, nullptr, mode, policy);
 }
 
-Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback sfunc, Mode mode) {
+Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback sfunc, Mode mode, const Policy& policy) {
     return TransferInternal(pbox, size, rfunc, nullptr, [sfunc](StartThreadCallback start, PullCallback pull) -> Result {
         R_TRY(start());
         return sfunc(pull);
-    }, mode);
+    }, mode, policy);
 }
 
-Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback2 sfunc, Mode mode) {
-    return TransferInternal(pbox, size, rfunc, nullptr, sfunc, mode);
+Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback2 sfunc, Mode mode, const Policy& policy) {
+    return TransferInternal(pbox, size, rfunc, nullptr, sfunc, mode, policy);
 }
 
-Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32, Mode mode) {
+Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32, Mode mode, const Policy& policy) {
     Result rc;
     if (R_FAILED(rc = fs->CreateDirectoryRecursivelyWithPath(path)) && rc != FsError_PathAlreadyExists) {
         log_write("failed to create folder: %s 0x%04X\n", path.s, rc);
@@ -471,7 +868,7 @@ Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::F
         [&](const void* data, s64 off, s64 size) -> Result {
             return f.Write(off, data, size, FsWriteOption_None);
         },
-        nullptr, mode, SMALL_BUFFER_SIZE
+        nullptr, mode, policy, SMALL_BUFFER_SIZE
     ));
 
     // validate crc32 (if set in the info).
@@ -480,7 +877,7 @@ Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::F
     R_SUCCEED();
 }
 
-Result TransferZip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, u32* crc32, Mode mode) {
+Result TransferZip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, u32* crc32, Mode mode, const Policy& policy) {
     fs::File f;
     R_TRY(fs->OpenFile(path, FsOpenMode_Read, &f));
 
@@ -506,11 +903,44 @@ Result TransferZip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsP
             }
             R_SUCCEED();
         },
-        nullptr, mode, SMALL_BUFFER_SIZE
+        nullptr, mode, policy, SMALL_BUFFER_SIZE
     );
 }
 
-Result TransferUnzipAll(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter, Mode mode) {
+Result TransferZipFile(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, const char* name_in_zip, const zip_fileinfo* info, int level, Mode mode, const Policy& policy) {
+    fs::File f;
+    R_TRY(fs->OpenFile(path, FsOpenMode_Read, &f));
+
+    s64 file_size;
+    R_TRY(f.GetSize(&file_size));
+
+    const auto zip64 = file_size >= 0xFFFFFFFF;
+
+    // only worth splitting when there's enough to compress.
+    if (mode == Mode::SingleThreaded || level == Z_NO_COMPRESSION || file_size < PARALLEL_ZIP_MIN_SIZE) {
+        f.Close();
+
+        if (ZIP_OK != zipOpenNewFileInZip64(zfile, name_in_zip, info, NULL, 0, NULL, 0, NULL, Z_DEFLATED, level, zip64)) {
+            log_write("failed to add zip for %s\n", path.s);
+            R_THROW(Result_ZipOpenNewFileInZip);
+        }
+        ON_SCOPE_EXIT(zipCloseFileInZip(zfile));
+
+        return TransferZip(pbox, zfile, fs, path, nullptr, mode, policy);
+    }
+
+    if (ZIP_OK != zipOpenNewFileInZip2_64(zfile, name_in_zip, info, NULL, 0, NULL, 0, NULL, Z_DEFLATED, level, 1, zip64)) {
+        log_write("failed to add raw zip for %s\n", path.s);
+        R_THROW(Result_ZipOpenNewFileInZip);
+    }
+
+    u32 crc32{};
+    const auto rc = ParallelZipRaw(pbox, zfile, f, file_size, level, &crc32);
+    zipCloseFileInZipRaw64(zfile, file_size, crc32);
+    return rc;
+}
+
+Result TransferUnzipAll(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter, Mode mode, const Policy& policy) {
     unz_global_info64 ginfo;
     if (UNZ_OK != unzGetGlobalInfo64(zfile, &ginfo)) {
         R_THROW(Result_UnzGetGlobalInfo64);
@@ -560,14 +990,14 @@ Result TransferUnzipAll(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs
                 R_THROW(rc);
             }
         } else {
-            R_TRY(TransferUnzip(pbox, zfile, fs, path, info.uncompressed_size, info.crc, mode));
+            R_TRY(TransferUnzip(pbox, zfile, fs, path, info.uncompressed_size, info.crc, mode, policy));
         }
     }
 
     R_SUCCEED();
 }
 
-Result TransferUnzipAll(ui::ProgressBox* pbox, const fs::FsPath& zip_out, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter, Mode mode) {
+Result TransferUnzipAll(ui::ProgressBox* pbox, const fs::FsPath& zip_out, fs::Fs* fs, const fs::FsPath& base_path, UnzipAllFilter filter, Mode mode, const Policy& policy) {
     zlib_filefunc64_def file_func;
     mz::FileFuncStdio(&file_func);
 
@@ -575,7 +1005,122 @@ Result TransferUnzipAll(ui::ProgressBox* pbox, const fs::FsPath& zip_out, fs::Fs
     R_UNLESS(zfile, Result_UnzOpen2_64);
     ON_SCOPE_EXIT(unzClose(zfile));
 
-    return TransferUnzipAll(pbox, zfile, fs, base_path, filter, mode);
+    // keep the old behaviour for fs that shouldn't be written to from multiple threads.
+    if (mode == Mode::SingleThreaded) {
+        return TransferUnzipAll(pbox, zfile, fs, base_path, filter, mode, policy);
+    }
+
+    unz_global_info64 ginfo;
+    if (UNZ_OK != unzGetGlobalInfo64(zfile, &ginfo)) {
+        R_THROW(Result_UnzGetGlobalInfo64);
+    }
+
+    if (UNZ_OK != unzGoToFirstFile(zfile)) {
+        R_THROW(Result_UnzGoToFirstFile);
+    }
+
+    // read the central directory once, then extract.
+    std::vector<fs::FsPath> folders;
+    std::vector<UnzipEntry> small_entries;
+    std::vector<UnzipEntry> large_entries;
+
+    for (s64 i = 0; i < ginfo.number_entry; i++) {
+        R_TRY(pbox->ShouldExitResult());
+
+        if (i > 0) {
+            if (UNZ_OK != unzGoToNextFile(zfile)) {
+                log_write("failed to unzGoToNextFile\n");
+                R_THROW(Result_UnzGoToNextFile);
+            }
+        }
+
+        unz_file_info64 info;
+        fs::FsPath name;
+        if (UNZ_OK != unzGetCurrentFileInfo64(zfile, &info, name, sizeof(name), 0, 0, 0, 0)) {
+            log_write("failed to get current info\n");
+            R_THROW(Result_UnzGetCurrentFileInfo64);
+        }
+
+        // check if we should skip this file.
+        auto path = fs::AppendPath(base_path, name);
+        if (filter && !filter(name, path)) {
+            continue;
+        }
+
+        const auto path_len = std::strlen(path);
+        if (path[path_len - 1] == '/') {
+            folders.emplace_back(path);
+            continue;
+        }
+
+        // remove the file name to get the parent folder.
+        auto folder = path;
+        if (auto slash = std::strrchr(folder, '/'); slash && slash != folder.s) {
+            *slash = '\0';
+            folders.emplace_back(folder);
+        }
+
+        UnzipEntry entry{path, {}, (s64)info.uncompressed_size, (u32)info.crc};
+        if (UNZ_OK != unzGetFilePos64(zfile, &entry.pos)) {
+            R_THROW(Result_UnzGetCurrentFileInfo64);
+        }
+
+        if (entry.size < PARALLEL_UNZIP_MAX_SIZE) {
+            small_entries.emplace_back(entry);
+        } else {
+            large_entries.emplace_back(entry);
+        }
+    }
+
+    // create each folder once, skipping folders that a deeper folder will create.
+    for (auto& folder : folders) {
+        if (const auto len = std::strlen(folder); len > 1 && folder[len - 1] == '/') {
+            folder[len - 1] = '\0';
+        }
+    }
+
+    std::ranges::sort(folders, [](const auto& a, const auto& b) {
+        return std::strcmp(a, b) < 0;
+    });
+
+    for (size_t i = 0; i < folders.size(); i++) {
+        const auto& folder = folders[i];
+        if (i + 1 < folders.size()) {
+            const auto& next = folders[i + 1];
+            const auto len = std::strlen(folder);
+            if (!std::strncmp(folder, next, len) && (next[len] == '/' || next[len] == '\0')) {
+                continue;
+            }
+        }
+
+        Result rc;
+        if (R_FAILED(rc = fs->CreateDirectoryRecursively(folder)) && rc != FsError_PathAlreadyExists) {
+            log_write("failed to create folder: %s 0x%04X\n", folder.s, rc);
+            R_THROW(rc);
+        }
+    }
+
+    R_TRY(ParallelUnzipEntries(pbox, zip_out, fs, small_entries));
+
+    for (const auto& e : large_entries) {
+        R_TRY(pbox->ShouldExitResult());
+
+        if (UNZ_OK != unzGoToFilePos64(zfile, &e.pos)) {
+            log_write("failed to go to file pos: %s\n", e.path.s);
+            R_THROW(Result_UnzGoToNextFile);
+        }
+
+        if (UNZ_OK != unzOpenCurrentFile(zfile)) {
+            log_write("failed to open current file\n");
+            R_THROW(Result_UnzOpenCurrentFile);
+        }
+        ON_SCOPE_EXIT(unzCloseCurrentFile(zfile));
+
+        pbox->NewTransfer(e.path);
+        R_TRY(TransferUnzip(pbox, zfile, fs, e.path, e.size, e.crc32, mode, policy));
+    }
+
+    R_SUCCEED();
 }
 
 } // namespace::thread
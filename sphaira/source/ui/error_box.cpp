@@ -59,7 +59,9 @@ auto GetCodeMessage(Result rc) -> const char* {
         case Result_NroBadSize: return "SphairaError_NroBadSize";
         case Result_AppFailedMusicDownload: return "SphairaError_AppFailedMusicDownload";
         case Result_CurlFailedEasyInit: return "SphairaError_CurlFailedEasyInit";
+        case Result_CurlFailedMultiInit: return "SphairaError_CurlFailedMultiInit";
         case Result_DumpFailedNetworkUpload: return "SphairaError_DumpFailedNetworkUpload";
+        case Result_DumpBadReadSize: return "SphairaError_DumpBadReadSize";
         case Result_UnzOpen2_64: return "SphairaError_UnzOpen2_64";
         case Result_UnzGetGlobalInfo64: return "SphairaError_UnzGetGlobalInfo64";
         case Result_UnzLocateFile: return "SphairaError_UnzLocateFile";
@@ -68,6 +70,8 @@ auto GetCodeMessage(Result rc) -> const char* {
         case Result_UnzOpenCurrentFile: return "SphairaError_UnzOpenCurrentFile";
         case Result_UnzGetCurrentFileInfo64: return "SphairaError_UnzGetCurrentFileInfo64";
         case Result_UnzReadCurrentFile: return "SphairaError_UnzReadCurrentFile";
+        case Result_UnzStreamUnsupported: return "SphairaError_UnzStreamUnsupported";
+        case Result_UnzStreamBadCrc32: return "SphairaError_UnzStreamBadCrc32";
         case Result_ZipOpen2_64: return "SphairaError_ZipOpen2_64";
         case Result_ZipOpenNewFileInZip: return "SphairaError_ZipOpenNewFileInZip";
         case Result_ZipWriteInFileInZip: return "SphairaError_ZipWriteInFileInZip";
@@ -362,10 +362,189 @@ auto UninstallApp(ProgressBox* pbox, const Entry& entry) -> Result {
     R_SUCCEED();
 }
 
+// returns false if the entry is not in the manifest, or should be skipped.
+auto GetManifestOutputPath(fs::Fs& fs, const ManifestEntries& manifest, const fs::FsPath& name, fs::FsPath& path) -> bool {
+    const auto it = std::ranges::find_if(manifest, [&name](auto& e){
+        return !strcasecmp(name, e.path);
+    });
+
+    if (it == manifest.end()) [[unlikely]] {
+        return false;
+    }
+
+    path = fs::AppendPath("/", name);
+
+    switch (it->command) {
+        case 'E': // both are the same?
+        case 'U':
+            return true;
+
+        case 'G': // checks if file exists, if not, extract
+            return !fs.FileExists(fs::AppendPath("/", it->path));
+
+        default:
+            log_write("bad command: %c\n", it->command);
+            return false;
+    }
+}
+
+// remove files no longer in the manifest
+void RemoveOldManifestEntries(fs::Fs& fs, const ManifestEntries& old_manifest, const ManifestEntries& new_manifest) {
+    for (auto& old_entry : old_manifest) {
+        bool found = false;
+        for (auto& new_entry : new_manifest) {
+            if (!strcasecmp(old_entry.path, new_entry.path)) {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            const auto safe_buf = fs::AppendPath("/", old_entry.path);
+            // std::strcat(safe_buf, old_entry.path);
+            if (R_FAILED(fs.DeleteFile(safe_buf))) {
+                log_write("failed to delete: %s\n", safe_buf.s);
+            } else {
+                log_write("deleted file: %s\n", safe_buf.s);
+                svcSleepThread(1e+5);
+            }
+        }
+    }
+}
+
+auto CheckMd5(const Entry& entry, const std::string& hash_out) -> Result {
+    if (hash_out.length() < entry.md5.length() || strncasecmp(hash_out.data(), entry.md5.data(), entry.md5.length())) {
+        log_write("bad md5: %.*s vs %.*s\n", 32, hash_out.data(), 32, entry.md5.c_str());
+        R_THROW(Result_AppstoreFailedMd5);
+    }
+
+    R_SUCCEED();
+}
+
+// extracts the zip whilst it's downloading, rather than saving it to the sd card
+// and reading it back. entries are staged and only moved into place once the
+// md5 has been checked, the manifest and info.json are moved last.
+// returns Result_UnzStreamUnsupported if the zip needs the central directory.
+auto InstallAppStreamed(ProgressBox* pbox, const Entry& entry, fs::FsNativeSd& fs, const ManifestEntries& old_manifest) -> Result {
+    static const fs::FsPath stage_dir{"/switch/sphaira/cache/appstore/stream"};
+
+    fs.DeleteDirectoryRecursively(stage_dir);
+    ON_SCOPE_EXIT(fs.DeleteDirectoryRecursively(stage_dir));
+
+    const auto info_path = BuildInfoCachePath(entry);
+    const auto manifest_path = BuildManifestCachePath(entry);
+    const auto staged_info_path = fs::AppendPath(stage_dir, "info.json");
+    const auto staged_manifest_path = fs::AppendPath(stage_dir, "manifest.install");
+
+    ManifestEntries new_manifest;
+    bool has_info{};
+    bool has_manifest{};
+    u32 stage_count{};
+    std::vector<std::pair<fs::FsPath, fs::FsPath>> staged; // name, staged path.
+
+    // moves a staged entry into place, or deletes it if it's not wanted.
+    const auto move_staged = [&](const fs::FsPath& name, const fs::FsPath& staged_path) -> Result {
+        fs::FsPath path;
+        if (!GetManifestOutputPath(fs, new_manifest, name, path)) {
+            fs.DeleteFile(staged_path);
+            R_SUCCEED();
+        }
+
+        fs.DeleteFile(path);
+        fs.CreateDirectoryRecursivelyWithPath(path);
+        return fs.RenameFile(staged_path, path);
+    };
+
+    // moves the staged file over the cached file.
+    const auto move_cache = [&](const fs::FsPath& staged_path, const fs::FsPath& path) -> Result {
+        fs.DeleteFile(path);
+        fs.CreateDirectoryRecursivelyWithPath(path);
+        return fs.RenameFile(staged_path, path);
+    };
+
+    mz::StreamUnzip unzip{&fs,
+        [&](const mz::StreamUnzip::Entry& e, fs::FsPath& path) -> Result {
+            if (!strcasecmp(e.name, "info.json")) {
+                path = staged_info_path;
+                has_info = true;
+            } else if (!strcasecmp(e.name, "manifest.install")) {
+                path = staged_manifest_path;
+            } else if (has_manifest && !GetManifestOutputPath(fs, new_manifest, e.name, path)) {
+                // skipped, such as 'G' entries that already exist.
+                path = {};
+            } else {
+                path = fs::AppendPath(stage_dir, std::to_string(stage_count++));
+                staged.emplace_back(e.name, path);
+            }
+
+            R_SUCCEED();
+        },
+        [&](const mz::StreamUnzip::Entry& e, const fs::FsPath& path) -> Result {
+            if (strcasecmp(e.name, "manifest.install")) {
+                R_SUCCEED();
+            }
+
+            std::vector<u8> data;
+            R_TRY(fs.read_entire_file(staged_manifest_path, data));
+            new_manifest = ParseManifest(std::span{(const char*)data.data(), data.size()});
+            if (new_manifest.empty()) {
+                log_write("manifest is empty!\n");
+                R_THROW(Result_AppstoreFailedParseManifest);
+            }
+
+            has_manifest = true;
+            R_SUCCEED();
+        }
+    };
+
+    pbox->NewTransfer("Downloading "_i18n + entry.title);
+    log_write("starting streamed download\n");
+    TimeStamp ts;
+
+    Result unzip_rc{};
+    const auto api_result = curl::Api().ToMemory(
+        curl::Url{BuildZipUrl(entry)},
+        curl::OnProgress{pbox->OnDownloadProgressCallback()},
+        curl::Hash{hash::Type::Md5},
+        curl::OnData{[&](const void* data, s64 size) -> bool {
+            unzip_rc = unzip.Push(data, size);
+            return R_SUCCEEDED(unzip_rc);
+        }}
+    );
+
+    R_TRY(unzip_rc);
+    R_UNLESS(api_result.success, Result_AppstoreFailedZipDownload);
+    R_TRY(unzip.Finish());
+
+    if (!has_manifest) {
+        log_write("failed to find manifest.install\n");
+        R_THROW(Result_UnzLocateFile);
+    }
+
+    // entries are crc32 checked as they're extracted, the md5 can only be
+    // checked once the download has finished, nothing has been moved yet.
+    R_TRY(CheckMd5(entry, api_result.hash));
+
+    for (const auto& [name, staged_path] : staged) {
+        R_TRY(move_staged(name, staged_path));
+    }
+
+    // the store uses these to check the installed version, so they're last.
+    if (has_info) {
+        R_TRY(move_cache(staged_info_path, info_path));
+    }
+    R_TRY(move_cache(staged_manifest_path, manifest_path));
+
+    log_write("\n\t[APPSTORE] finished streamed extract, time taken: %.2fs %zums\n\n", ts.GetSecondsD(), ts.GetMs());
+
+    RemoveOldManifestEntries(fs, old_manifest, new_manifest);
+    R_SUCCEED();
+}
+
 // this is called by ProgressBox on a seperate thread
 // it has 4 main steps
 // 1. download the zip
-// 2. md5 check the zip
+// 2. md5 check the zip (hashed whilst downloading)
 // 3. parse manifest and unzip everything to placeholder
 // 4. move everything from placeholder to normal location
 auto InstallApp(ProgressBox* pbox, const Entry& entry) -> Result {
@@ -375,11 +554,27 @@ auto InstallApp(ProgressBox* pbox, const Entry& entry) -> Result {
     fs::FsNativeSd fs;
     R_TRY(fs.GetFsOpenResult());
 
+    // load this now as extracting will replace the manifest.
+    const auto old_manifest = LoadAndParseManifest(entry);
+
     // check if we can download the entire zip to mem for faster download / extract times.
     // current limit is 300MiB, or disabled for applet mode.
     const auto file_download = App::IsApplet() || entry.filesize >= 1024 * 1024 * 300;
     curl::ApiResult api_result{};
 
+    // zips too big for memory are extracted whilst downloading if possible.
+    if (file_download && !pbox->ShouldExit()) {
+        const auto rc = InstallAppStreamed(pbox, entry, fs, old_manifest);
+        if (rc != Result_UnzStreamUnsupported) {
+            if (R_SUCCEEDED(rc)) {
+                log_write("finished install :)\n");
+            }
+            return rc;
+        }
+
+        log_write("zip cannot be streamed, falling back to downloading to file\n");
+    }
+
     // 1. download the zip
     if (!pbox->ShouldExit()) {
         pbox->NewTransfer("Downloading "_i18n + entry.title);
@@ -388,11 +583,13 @@ auto InstallApp(ProgressBox* pbox, const Entry& entry) -> Result {
         const auto url = BuildZipUrl(entry);
         curl::Api api{
             curl::Url{url},
-            curl::OnProgress{pbox->OnDownloadProgressCallback()}
+            curl::OnProgress{pbox->OnDownloadProgressCallback()},
+            curl::Hash{hash::Type::Md5}
         };
 
         if (file_download) {
             api.SetOption(curl::Path{zip_out});
+            api.SetOption(curl::Flags{curl::Flag_Resume});
             api_result = curl::ToFile(api);
         } else {
             api_result = curl::ToMemory(api);
@@ -405,20 +602,7 @@ auto InstallApp(ProgressBox* pbox, const Entry& entry) -> Result {
 
     // 2. md5 check the zip
     if (!pbox->ShouldExit()) {
-        pbox->NewTransfer("Checking MD5"_i18n);
-        log_write("starting md5 check\n");
-
-        std::string hash_out;
-        if (file_download) {
-            R_TRY(hash::Hash(pbox, hash::Type::Md5, &fs, zip_out, hash_out));
-        } else {
-            R_TRY(hash::Hash(pbox, hash::Type::Md5, api_result.data, hash_out));
-        }
-
-        if (strncasecmp(hash_out.data(), entry.md5.data(), entry.md5.length())) {
-            log_write("bad md5: %.*s vs %.*s\n", 32, hash_out.data(), 32, entry.md5.c_str());
-            R_THROW(Result_AppstoreFailedMd5);
-        }
+        R_TRY(CheckMd5(entry, api_result.hash));
     }
 
     mz::MzSpan mz_span{api_result.data};
@@ -442,7 +626,6 @@ auto InstallApp(ProgressBox* pbox, const Entry& entry) -> Result {
         }
 
         ManifestEntries new_manifest;
-        const auto old_manifest = LoadAndParseManifest(entry);
         {
             if (UNZ_OK != unzOpenCurrentFile(zfile)) {
                 log_write("failed to open current file\n");
@@ -505,53 +688,18 @@ auto InstallApp(ProgressBox* pbox, const Entry& entry) -> Result {
         #endif
 
         R_TRY(thread::TransferUnzipAll(pbox, zfile, &fs, "/", [&](const fs::FsPath& name, fs::FsPath& path) -> bool {
-            const auto it = std::ranges::find_if(new_manifest, [&name](auto& e){
-                return !strcasecmp(name, e.path);
-            });
-
-            if (it == new_manifest.end()) [[unlikely]] {
+            if (!GetManifestOutputPath(fs, new_manifest, name, path)) {
                 return false;
             }
 
-            pbox->NewTransfer(it->path);
-
-            switch (it->command) {
-                case 'E': // both are the same?
-                case 'U':
-                    return true;
-
-                case 'G': // checks if file exists, if not, extract
-                    return !fs.FileExists(fs::AppendPath("/", it->path));
-
-                default:
-                    log_write("bad command: %c\n", it->command);
-                    return false;
-            }
+            pbox->NewTransfer(name);
+            return true;
         }));
 
         log_write("\n\t[APPSTORE] finished extract new, time taken: %.2fs %zums\n\n", ts.GetSecondsD(), ts.GetMs());
 
         // finally finally, remove files no longer in the manifest
-        for (auto& old_entry : old_manifest) {
-            bool found = false;
-            for (auto& new_entry : new_manifest) {
-                if (!strcasecmp(old_entry.path, new_entry.path)) {
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) {
-                const auto safe_buf = fs::AppendPath("/", old_entry.path);
-                // std::strcat(safe_buf, old_entry.path);
-                if (R_FAILED(fs.DeleteFile(safe_buf))) {
-                    log_write("failed to delete: %s\n", safe_buf.s);
-                } else {
-                    log_write("deleted file: %s\n", safe_buf.s);
-                    svcSleepThread(1e+5);
-                }
-            }
-        }
+        RemoveOldManifestEntries(fs, old_manifest, new_manifest);
     }
 
     log_write("finished install :)\n");
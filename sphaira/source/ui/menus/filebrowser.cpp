@@ -706,6 +706,7 @@ void FsView::InstallFiles() {
             App::PopToMenu();
 
             App::Push<ui::ProgressBox>(0, "Installing "_i18n, "", [this, targets](auto pbox) -> Result {
+                yati::Session session{};
                 for (auto& e : targets) {
                     R_TRY(yati::InstallFromFile(pbox, m_fs.get(), GetNewPath(e)));
                     App::Notify("Installed "_i18n + e.GetName());
@@ -822,13 +823,7 @@ void FsView::ZipFiles(fs::FsPath zip_out) {
 
             pbox->NewTransfer(file_name_in_zip);
 
-            if (ZIP_OK != zipOpenNewFileInZip(zfile, file_name_in_zip, &zip_info, NULL, 0, NULL, 0, NULL, Z_DEFLATED, Z_DEFAULT_COMPRESSION)) {
-                log_write("failed to add zip for %s\n", file_path.s);
-                R_THROW(Result_ZipOpenNewFileInZip);
-            }
-            ON_SCOPE_EXIT(zipCloseFileInZip(zfile));
-
-            return thread::TransferZip(pbox, zfile, m_fs.get(), file_path, nullptr, is_hdd_fs ? thread::Mode::SingleThreaded : thread::Mode::SingleThreadedIfSmaller);
+            return thread::TransferZipFile(pbox, zfile, m_fs.get(), file_path, file_name_in_zip, &zip_info, Z_DEFAULT_COMPRESSION, is_hdd_fs ? thread::Mode::SingleThreaded : thread::Mode::SingleThreadedIfSmaller);
         };
 
         for (auto& e : targets) {
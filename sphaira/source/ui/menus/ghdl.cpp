@@ -100,7 +100,9 @@ auto DownloadApp(ProgressBox* pbox, const GhApiAsset& gh_asset, const AssetEntry
         const auto result = curl::Api().ToFile(
             curl::Url{gh_asset.browser_download_url},
             curl::Path{temp_file},
-            curl::OnProgress{pbox->OnDownloadProgressCallback()}
+            curl::OnProgress{pbox->OnDownloadProgressCallback()},
+            curl::Flags{curl::Flag_Resume},
+            curl::Segments{4}
         );
 
         R_UNLESS(result.success, Result_GhdlFailedToDownloadAsset);
@@ -16,8 +16,12 @@ enum class InstallState {
     Finished,
 };
 
+// the writer waits for the reader once this much is buffered.
 constexpr u64 MAX_BUFFER_SIZE = 1024ULL*1024ULL*8ULL;
+// initial size of the circular buffer, leaves room for data pushed whilst full.
 constexpr u64 MAX_BUFFER_RESERVE_SIZE = 1024ULL*1024ULL*32ULL;
+// max time the writer will wait for the reader before accepting data anyway.
+constexpr u64 MAX_PUSH_WAIT_NS = 1e+9;
 volatile InstallState INSTALL_STATE{InstallState::None};
 
 } // namespace
@@ -26,10 +30,11 @@ Stream::Stream(const fs::FsPath& path, std::stop_token token) {
     m_path = path;
     m_token = token;
     m_active = true;
-    m_buffer.reserve(MAX_BUFFER_RESERVE_SIZE);
+    m_buffer.resize(MAX_BUFFER_RESERVE_SIZE);
 
     mutexInit(&m_mutex);
     condvarInit(&m_can_read);
+    condvarInit(&m_can_write);
 }
 
 Result Stream::ReadChunk(void* buf, s64 size, u64* bytes_read) {
@@ -38,24 +43,42 @@ Result Stream::ReadChunk(void* buf, s64 size, u64* bytes_read) {
         log_write("[Stream::ReadChunk] exiting\n");
     );
 
+    return Pop(buf, size, bytes_read);
+}
+
+Result Stream::SkipChunk(s64 size, u64* bytes_skipped) {
+    // the data is already in memory, so there's no need to copy it out.
+    return Pop(nullptr, size, bytes_skipped);
+}
+
+Result Stream::Pop(void* buf, s64 size, u64* bytes_read) {
     while (!m_token.stop_requested()) {
         SCOPED_MUTEX(&m_mutex);
-        if (m_active && m_buffer.empty()) {
+        if (m_active && !m_size) {
             condvarWait(&m_can_read, &m_mutex);
         }
 
-        if ((!m_active && m_buffer.empty()) || m_token.stop_requested()) {
+        if ((!m_active && !m_size) || m_token.stop_requested()) {
             break;
         }
 
-        size = std::min<s64>(size, m_buffer.size());
-        std::memcpy(buf, m_buffer.data(), size);
-        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + size);
+        // copy out in up to 2 parts, the data may wrap around.
+        size = std::min<s64>(size, m_size);
+        if (buf) {
+            const auto first = std::min<s64>(size, m_buffer.size() - m_read_offset);
+            std::memcpy(buf, m_buffer.data() + m_read_offset, first);
+            std::memcpy(static_cast<u8*>(buf) + first, m_buffer.data(), size - first);
+        }
+
+        m_read_offset = (m_read_offset + size) % m_buffer.size();
+        m_size -= size;
         *bytes_read = size;
+
+        condvarWakeOne(&m_can_write);
         R_SUCCEED();
     }
 
-    log_write("[Stream::ReadChunk] failed to read\n");
+    log_write("[Stream::Pop] failed to read\n");
     R_THROW(Result_TransferCancelled);
 }
 
@@ -71,18 +94,21 @@ bool Stream::Push(const void* buf, s64 size) {
             return true;
         }
 
-        // don't use condivar here as windows mtp is very broken.
-        // stalling for too longer (3s+) and having too varied transfer speeds
-        // results in windows stalling the transfer for 1m until it kills it via timeout.
-        // the workaround is to always accept new data, but stall for 1s.
+        // windows mtp is very broken, stalling for too long (3s+) and having
+        // too varied transfer speeds results in windows stalling the transfer
+        // for 1m until it kills it via timeout.
+        // the workaround is to wait for the reader for at most 1s, then always
+        // accept the new data, growing the buffer if needed.
         SCOPED_MUTEX(&m_mutex);
-        if (m_active && m_buffer.size() >= MAX_BUFFER_SIZE) {
-            // unlock the mutex and wait for 1s to bring transfer speed down to 1MiB/s.
-            log_write("[Stream::Push] buffer is full, delaying\n");
-            mutexUnlock(&m_mutex);
-            ON_SCOPE_EXIT(mutexLock(&m_mutex));
+        const auto start = armGetSystemTick();
+        while (m_active && m_size >= (s64)MAX_BUFFER_SIZE && !m_token.stop_requested()) {
+            const auto waited = armTicksToNs(armGetSystemTick() - start);
+            if (waited >= MAX_PUSH_WAIT_NS) {
+                log_write("[Stream::Push] buffer is full, accepting anyway\n");
+                break;
+            }
 
-            svcSleepThread(1e+9);
+            condvarWaitTimeout(&m_can_write, &m_mutex, MAX_PUSH_WAIT_NS - waited);
         }
 
         if (!m_active) {
@@ -90,9 +116,17 @@ bool Stream::Push(const void* buf, s64 size) {
             break;
         }
 
-        const auto offset = m_buffer.size();
-        m_buffer.resize(offset + size);
-        std::memcpy(m_buffer.data() + offset, buf, size);
+        if (m_size + size > (s64)m_buffer.size()) {
+            Grow(m_size + size);
+        }
+
+        // copy in up to 2 parts, the data may wrap around.
+        const auto write_offset = (m_read_offset + m_size) % m_buffer.size();
+        const auto first = std::min<s64>(size, m_buffer.size() - write_offset);
+        std::memcpy(m_buffer.data() + write_offset, buf, first);
+        std::memcpy(m_buffer.data(), static_cast<const u8*>(buf) + first, size - first);
+
+        m_size += size;
         condvarWakeOne(&m_can_read);
         return true;
     }
@@ -101,12 +135,26 @@ bool Stream::Push(const void* buf, s64 size) {
     return false;
 }
 
+void Stream::Grow(s64 size) {
+    log_write("[Stream::Grow] growing buffer: %zu\n", (size_t)size);
+
+    // unwrap the data into the new buffer.
+    std::vector<u8> buffer(std::max<s64>(size, m_buffer.size() * 2));
+    const auto first = std::min<s64>(m_size, m_buffer.size() - m_read_offset);
+    std::memcpy(buffer.data(), m_buffer.data() + m_read_offset, first);
+    std::memcpy(buffer.data() + first, m_buffer.data(), m_size - first);
+
+    m_buffer = std::move(buffer);
+    m_read_offset = 0;
+}
+
 void Stream::Disable() {
     log_write("[Stream::Disable] disabling file\n");
 
     SCOPED_MUTEX(&m_mutex);
     m_active = false;
     condvarWakeOne(&m_can_read);
+    condvarWakeOne(&m_can_write);
 }
 
 Menu::Menu(const std::string& title, u32 flags) : MenuBase{title, flags} {
@@ -985,19 +985,17 @@ Result Menu::BackupSaveInternal(ProgressBox* pbox, const dump::DumpLocation& loc
     fs->CreateDirectoryRecursivelyWithPath(temp_path);
     ON_SCOPE_EXIT(fs->DeleteFile(temp_path));
 
-    // zip to memory if less than 1GB and not applet mode.
-    // TODO: use my mmz code from ftpsrv to stream zip creation.
-    // this will allow for zipping to memory and flushing every X bytes
-    // such as flushing every 8MB.
-    const auto file_download = App::IsApplet() || e.size >= 1024ULL * 1024ULL * 1024ULL;
+    fs->DeleteFile(temp_path);
+    R_TRY(fs->CreateFile(temp_path, 0, 0));
 
-    mz::MzMem mz_mem{};
+    fs::File file;
+    R_TRY(fs->OpenFile(temp_path, FsOpenMode_Write|FsOpenMode_Append, &file));
+
+    // stream the zip to the file, flushing every 8MiB whilst the next chunk is compressed.
+    const auto is_file_based_emummc = App::IsFileBaseEmummc();
+    mz::MzFile mz_file{&file, 1024 * 1024 * 8, is_file_based_emummc ? (u64)2e+6 : 0};
     zlib_filefunc64_def file_func;
-    if (!file_download) {
-        mz::FileFuncMem(&mz_mem, &file_func);
-    } else {
-        mz::FileFuncStdio(&file_func);
-    }
+    mz::FileFuncFile(&mz_file, &file_func);
 
     {
         auto zfile = zipOpen2_64(temp_path, APPEND_STATUS_CREATE, nullptr, &file_func);
@@ -1041,13 +1039,7 @@ Result Menu::BackupSaveInternal(ProgressBox* pbox, const dump::DumpLocation& loc
             pbox->NewTransfer(file_name_in_zip);
 
             const auto level = compressed ? Z_DEFAULT_COMPRESSION : Z_NO_COMPRESSION;
-            if (ZIP_OK != zipOpenNewFileInZip(zfile, file_name_in_zip, &zip_info_default, NULL, 0, NULL, 0, NULL, Z_DEFLATED, level)) {
-                log_write("failed to add zip for %s\n", file_path.s);
-                R_THROW(Result_ZipOpenNewFileInZip);
-            }
-            ON_SCOPE_EXIT(zipCloseFileInZip(zfile));
-
-            return thread::TransferZip(pbox, zfile, &save_fs, file_path);
+            return thread::TransferZipFile(pbox, zfile, &save_fs, file_path, file_name_in_zip, &zip_info_default, level);
         };
 
         // loop through every save file and store to zip.
@@ -1059,31 +1051,8 @@ Result Menu::BackupSaveInternal(ProgressBox* pbox, const dump::DumpLocation& loc
         }
     }
 
-    // if we dumped the save to ram, flush the data to file.
-    const auto is_file_based_emummc = App::IsFileBaseEmummc();
-    if (!file_download) {
-        pbox->NewTransfer("Flushing zip to file");
-        R_TRY(fs->CreateFile(temp_path, mz_mem.buf.size(), 0));
-
-        fs::File file;
-        R_TRY(fs->OpenFile(temp_path, FsOpenMode_Write, &file));
-
-        R_TRY(thread::Transfer(pbox, mz_mem.buf.size(),
-            [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
-                size = std::min<s64>(size, mz_mem.buf.size() - off);
-                std::memcpy(data, mz_mem.buf.data() + off, size);
-                *bytes_read = size;
-                R_SUCCEED();
-            },
-            [&](const void* data, s64 off, s64 size) -> Result {
-                const auto rc = file.Write(off, data, size, FsWriteOption_None);
-                if (is_file_based_emummc) {
-                    svcSleepThread(2e+6); // 2ms
-                }
-                return rc;
-            }
-        ));
-    }
+    R_TRY(mz_file.Close());
+    file.Close();
 
     fs->DeleteFile(path);
     R_TRY(fs->RenameFile(temp_path, path));
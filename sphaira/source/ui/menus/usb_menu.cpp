@@ -113,6 +113,7 @@ void Menu::Update(Controller* controller, TouchInfo* touch) {
             ON_SCOPE_EXIT(m_usb_source->Finished(FINISHED_TIMEOUT));
 
             log_write("inside progress box\n");
+            yati::Session session{};
             for (const auto& file_name : m_names) {
                 m_usb_source->SetFileNameForTranfser(file_name);
                 const auto rc = yati::InstallFromSource(pbox, m_usb_source.get(), file_name);
@@ -22,8 +22,15 @@
 #include "app.hpp"
 #include <ranges>
 #include <cstring>
+#include <algorithm>
 
 namespace sphaira::usb {
+namespace {
+
+// size of each chunk that is in flight when double buffering.
+constexpr s64 TRANSFER_CHUNK_SIZE = 1024 * 1024 * 4;
+
+} // namespace
 
 Base::Base(u64 transfer_timeout) {
     App::SetAutoSleepDisabled(true);
@@ -31,7 +38,9 @@ Base::Base(u64 transfer_timeout) {
     m_transfer_timeout = transfer_timeout;
     ueventCreate(GetCancelEvent(), true);
     // this avoids allocations during transfers.
-    m_aligned.reserve(1024 * 1024 * 16);
+    for (auto& chunk : m_chunks) {
+        chunk.resize(TRANSFER_CHUNK_SIZE);
+    }
 }
 
 Base::~Base() {
@@ -40,13 +49,21 @@ Base::~Base() {
 
 Result Base::TransferPacketImpl(bool read, void *page, u32 remaining, u32 size, u32 *out_size_transferred, u64 timeout) {
     u32 xfer_id;
+    R_TRY(TransferPacketBegin(read, page, remaining, size, std::addressof(xfer_id), timeout));
+    return TransferPacketEnd(read, xfer_id, out_size_transferred, timeout);
+}
 
+Result Base::TransferPacketBegin(bool read, void *page, u32 remaining, u32 size, u32 *out_xfer_id, u64 timeout) {
     /* If we're not configured yet, wait to become configured first. */
     R_TRY(IsUsbConnected(timeout));
 
     /* Select the appropriate endpoint and begin a transfer. */
     const auto ep = read ? UsbSessionEndpoint_Out : UsbSessionEndpoint_In;
-    R_TRY(TransferAsync(ep, page, remaining, size, std::addressof(xfer_id)));
+    return TransferAsync(ep, page, remaining, size, out_xfer_id);
+}
+
+Result Base::TransferPacketEnd(bool read, u32 xfer_id, u32 *out_size_transferred, u64 timeout) {
+    const auto ep = read ? UsbSessionEndpoint_Out : UsbSessionEndpoint_In;
 
     /* Try to wait for the event. */
     R_TRY(WaitTransferCompletion(ep, timeout));
@@ -55,48 +72,117 @@ Result Base::TransferPacketImpl(bool read, void *page, u32 remaining, u32 size,
     return GetTransferResult(ep, xfer_id, nullptr, out_size_transferred);
 }
 
-// while it may seem like a bad idea to transfer data to a buffer and copy it
-// in practice, this has no impact on performance.
-// the switch is *massively* bottlenecked by slow io (nand and sd).
-// so making usb transfers zero-copy provides no benefit other than increased
-// code complexity and the increase of future bugs if/when sphaira is forked
-// an changes are made.
-// yati already goes to great lengths to be zero-copy during installing
-// by swapping buffers and inflating in-place.
+// data is transferred in chunks via 2 aligned buffers, the copy to / from the
+// callers buffer happens whilst the previous / next chunk is in flight, so
+// the copy is hidden behind the transfer.
 
-// NOTE: it is now possible to request the transfer buffer using GetTransferBuffer(),
+// NOTE: it is also possible to request the transfer buffer using GetTransferBuffer(),
 // which will always be aligned and have the size aligned.
 // this allows for zero-copy transferrs to take place.
-// this is used in usb_upload.cpp.
 // do note that this relies of the host sending / receiving buffers of an aligned size.
+// for large transfers, prefer TransferAllWrite() / TransferAllRead() which
+// let the caller produce / consume the data in place.
 Result Base::TransferAll(bool read, void *data, u32 size, u64 timeout) {
     auto buf = static_cast<u8*>(data);
-    auto transfer_buf = m_aligned.data();
-    const auto alias = buf == transfer_buf;
 
-    if (!alias) {
-        m_aligned.resize(size);
+    if (buf == m_aligned.data()) {
+        while (size) {
+            u32 out_size_transferred;
+            R_TRY(TransferPacketImpl(read, buf, size, size, &out_size_transferred, timeout));
+            buf += out_size_transferred;
+            size -= out_size_transferred;
+        }
+
+        R_SUCCEED();
+    }
+
+    if (read) {
+        return TransferAllRead(size, [buf](const void* chunk, s64 off, s64 size) -> Result {
+            std::memcpy(buf + off, chunk, size);
+            R_SUCCEED();
+        }, timeout);
+    } else {
+        return TransferAllWrite(size, [buf](void* chunk, s64 off, s64 size) -> Result {
+            std::memcpy(chunk, buf + off, size);
+            R_SUCCEED();
+        }, timeout);
+    }
+}
+
+// only a single transfer is in flight per endpoint, as the completion event
+// is shared between all transfers on an endpoint.
+Result Base::TransferAllWrite(s64 size, const FillCallback& fill, u64 timeout) {
+    if (!size) {
+        R_SUCCEED();
     }
 
-    while (size) {
-        if (!alias && !read) {
-            std::memcpy(transfer_buf, buf, size);
+    u32 index = 0;
+    R_TRY(fill(m_chunks[index].data(), 0, std::min(size, TRANSFER_CHUNK_SIZE)));
+
+    for (s64 off = 0; off < size;) {
+        const auto page = m_chunks[index].data();
+        const u32 chunk_size = std::min(size - off, TRANSFER_CHUNK_SIZE);
+
+        u32 xfer_id;
+        R_TRY(TransferPacketBegin(false, page, size - off, chunk_size, &xfer_id, timeout));
+
+        // fill the next chunk whilst this one is being sent.
+        const auto next_off = off + chunk_size;
+        Result fill_rc{};
+        if (next_off < size) {
+            fill_rc = fill(m_chunks[index ^ 1].data(), next_off, std::min(size - next_off, TRANSFER_CHUNK_SIZE));
         }
 
-        u32 out_size_transferred;
-        R_TRY(TransferPacketImpl(read, transfer_buf, size, size, &out_size_transferred, timeout));
+        u32 transferred;
+        R_TRY(TransferPacketEnd(false, xfer_id, &transferred, timeout));
+        R_TRY(fill_rc);
 
-        if (!alias && read) {
-            std::memcpy(buf, transfer_buf, out_size_transferred);
+        // send the rest of the chunk if the transfer was short.
+        while (transferred < chunk_size) {
+            u32 out_size_transferred;
+            R_TRY(TransferPacketImpl(false, page + transferred, size - off - transferred, chunk_size - transferred, &out_size_transferred, timeout));
+            transferred += out_size_transferred;
         }
 
-        if (alias) {
-            transfer_buf += out_size_transferred;
-        } else {
-            buf += out_size_transferred;
+        off = next_off;
+        index ^= 1;
+    }
+
+    R_SUCCEED();
+}
+
+Result Base::TransferAllRead(s64 size, const DrainCallback& drain, u64 timeout) {
+    u32 index = 0;
+    const u8* prev_chunk{};
+    s64 prev_off{};
+    u32 prev_size{};
+
+    for (s64 off = 0; off < size;) {
+        const auto page = m_chunks[index].data();
+        const u32 chunk_size = std::min(size - off, TRANSFER_CHUNK_SIZE);
+
+        u32 xfer_id;
+        R_TRY(TransferPacketBegin(true, page, size - off, chunk_size, &xfer_id, timeout));
+
+        // drain the previous chunk whilst this one is being received.
+        Result drain_rc{};
+        if (prev_size) {
+            drain_rc = drain(prev_chunk, prev_off, prev_size);
         }
 
-        size -= out_size_transferred;
+        u32 transferred;
+        R_TRY(TransferPacketEnd(true, xfer_id, &transferred, timeout));
+        R_TRY(drain_rc);
+
+        prev_chunk = page;
+        prev_off = off;
+        prev_size = transferred;
+        off += transferred;
+        index ^= 1;
+    }
+
+    if (prev_size) {
+        R_TRY(drain(prev_chunk, prev_off, prev_size));
     }
 
     R_SUCCEED();
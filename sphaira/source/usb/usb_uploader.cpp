@@ -4,6 +4,8 @@
 #include "usb/tinfoil.hpp"
 #include "log.hpp"
 #include "defines.hpp"
+#include <algorithm>
+#include <cstring>
 
 namespace sphaira::usb::upload {
 namespace {
@@ -35,6 +37,9 @@ const UsbHsInterfaceFilter FILTER{
 
 constexpr u8 INDEX = 0;
 
+// max size of the next range to read whilst the current one is being sent.
+constexpr s64 PREFETCH_MAX_SIZE = 1024 * 1024 * 8;
+
 } // namespace
 
 Usb::Usb(u64 transfer_timeout) {
@@ -43,6 +48,7 @@ Usb::Usb(u64 transfer_timeout) {
 }
 
 Usb::~Usb() {
+    WaitForPrefetch();
 }
 
 Result Usb::WaitForConnection(u64 timeout, u8 flags, std::span<const std::string> names) {
@@ -88,26 +94,109 @@ Result Usb::FileRangeCmd(u64 data_size) {
     // send response header.
     R_TRY(m_usb->TransferAll(false, &header, sizeof(header)));
 
-    s64 curr_off = 0x0;
-    s64 end_off = header.size;
-    s64 read_size = header.size;
-
-    // use transfer buffer directly to avoid copy overhead.
-    auto& buf = m_usb->GetTransferBuffer();
-    buf.resize(header.size);
+    // the cache is only valid after the prefetch has finished.
+    WaitForPrefetch();
+
+    // the next chunk is read from the file whilst the previous one is sent.
+    const s64 range_end = header.offset + header.size;
+    R_TRY(m_usb->TransferAllWrite(header.size, [&](void* buf, s64 off, s64 size) -> Result {
+        auto dst = static_cast<u8*>(buf);
+        off += header.offset;
+
+        while (size) {
+            // use the data that was prefetched if we have it.
+            const auto cache_end = m_cache.offset + (s64)m_cache.data.size();
+            if (m_cache.path == path && off >= m_cache.offset && off < cache_end) {
+                const auto copy_size = std::min(size, cache_end - off);
+                std::memcpy(dst, m_cache.data.data() + (off - m_cache.offset), copy_size);
+                dst += copy_size;
+                off += copy_size;
+                size -= copy_size;
+                continue;
+            }
+
+            u64 bytes_read;
+            R_TRY(Read(path, dst, off, size, &bytes_read));
+            R_UNLESS(bytes_read, Result_UsbUploadBadTransferSize);
+            dst += bytes_read;
+            off += bytes_read;
+            size -= bytes_read;
+        }
 
-    while (curr_off < end_off) {
-        if (curr_off + read_size >= end_off) {
-            read_size = end_off - curr_off;
+        // all of the range has been read, start reading the next range whilst
+        // the last chunk is sent and the host sends the next command.
+        // this is skipped if the cache still has data past this range.
+        const auto cache_end = m_cache.offset + (s64)m_cache.data.size();
+        if (off == range_end && (m_cache.path != path || cache_end <= range_end)) {
+            const auto file_size = GetFileSize(path);
+            const auto prefetch_size = std::min({(s64)header.size, PREFETCH_MAX_SIZE, file_size - range_end});
+            if (prefetch_size > 0) {
+                StartPrefetch(path, range_end, prefetch_size);
+            }
         }
 
-        u64 bytes_read;
-        R_TRY(Read(path, buf.data(), header.offset + curr_off, read_size, &bytes_read));
-        R_TRY(m_usb->TransferAll(false, buf.data(), bytes_read));
-        curr_off += bytes_read;
-    }
+        R_SUCCEED();
+    }));
 
     R_SUCCEED();
 }
 
+void Usb::StartPrefetch(const std::string& path, s64 off, s64 size) {
+    m_prefetch.path = path;
+    m_prefetch.offset = off;
+    m_prefetch.data.resize(size);
+
+    const auto func = [](void* arg) {
+        auto usb = static_cast<Usb*>(arg);
+        auto& prefetch = usb->m_prefetch;
+
+        auto dst = prefetch.data.data();
+        auto off = prefetch.offset;
+        auto size = (s64)prefetch.data.size();
+
+        usb->m_prefetch_rc = [&]() -> Result {
+            while (size) {
+                u64 bytes_read;
+                R_TRY(usb->Read(prefetch.path, dst, off, size, &bytes_read));
+                R_UNLESS(bytes_read, Result_UsbUploadBadTransferSize);
+                dst += bytes_read;
+                off += bytes_read;
+                size -= bytes_read;
+            }
+            R_SUCCEED();
+        }();
+    };
+
+    if (R_FAILED(threadCreate(&m_prefetch_thread, func, this, nullptr, 1024*128, PRIO_PREEMPTIVE, -2))) {
+        log_write("[USB] failed to create prefetch thread\n");
+        return;
+    }
+
+    if (R_FAILED(threadStart(&m_prefetch_thread))) {
+        log_write("[USB] failed to start prefetch thread\n");
+        threadClose(&m_prefetch_thread);
+        return;
+    }
+
+    m_prefetch_pending = true;
+}
+
+void Usb::WaitForPrefetch() {
+    if (!m_prefetch_pending) {
+        return;
+    }
+
+    threadWaitForExit(&m_prefetch_thread);
+    threadClose(&m_prefetch_thread);
+    m_prefetch_pending = false;
+
+    // on failure, the range is read again when it's requested.
+    if (R_SUCCEEDED(m_prefetch_rc)) {
+        std::swap(m_cache, m_prefetch);
+    } else {
+        log_write("[USB] prefetch failed: 0x%X\n", m_prefetch_rc);
+        m_cache.data.clear();
+    }
+}
+
 } // namespace sphaira::usb::upload
@@ -0,0 +1,121 @@
+#include "yati/nx/crypto.hpp"
+#include "defines.hpp"
+#include "log.hpp"
+#include <algorithm>
+
+namespace sphaira::crypto {
+namespace {
+
+// spans smaller than this are crypted on the calling thread, as waking
+// the workers costs more than it saves.
+constexpr u64 CTR_PARALLEL_MIN = 1024 * 256;
+
+} // namespace
+
+Aes128CtrPool::Aes128CtrPool() {
+    mutexInit(std::addressof(m_mutex));
+    condvarInit(std::addressof(m_can_work));
+    condvarInit(std::addressof(m_done));
+}
+
+Aes128CtrPool::~Aes128CtrPool() {
+    Close();
+}
+
+Result Aes128CtrPool::Create() {
+    for (u32 i = 0; i < MAX_THREADS; i++) {
+        auto worker = std::addressof(m_workers[m_thread_count]);
+        worker->pool = this;
+
+        R_TRY(threadCreate(std::addressof(worker->thread), WorkerFunc, worker, nullptr, 1024*32, PRIO_PREEMPTIVE, i));
+
+        if (const auto rc = threadStart(std::addressof(worker->thread)); R_FAILED(rc)) {
+            threadClose(std::addressof(worker->thread));
+            R_THROW(rc);
+        }
+
+        m_thread_count++;
+    }
+
+    log_write("[CTR] created pool, threads: %u\n", m_thread_count);
+    R_SUCCEED();
+}
+
+void Aes128CtrPool::Close() {
+    mutexLock(std::addressof(m_mutex));
+    m_quit = true;
+    condvarWakeAll(std::addressof(m_can_work));
+    mutexUnlock(std::addressof(m_mutex));
+
+    for (u32 i = 0; i < m_thread_count; i++) {
+        threadWaitForExit(std::addressof(m_workers[i].thread));
+        threadClose(std::addressof(m_workers[i].thread));
+    }
+
+    m_thread_count = 0;
+    m_quit = false;
+}
+
+void Aes128CtrPool::Run(const void *key, const void *ctr, u64 offset, void *buf, u64 size) {
+    if (!m_thread_count || size < CTR_PARALLEL_MIN) {
+        Aes128Ctr(key, ctr, offset).Run(buf, buf, size);
+        return;
+    }
+
+    // split into equal parts, aligned to the block size so that only the
+    // first part can start within a block.
+    const auto parts = m_thread_count + 1;
+    const auto part_size = ((size / parts) + 0xF) & ~u64(0xF);
+    auto data = static_cast<u8*>(buf);
+
+    mutexLock(std::addressof(m_mutex));
+    u64 pos = part_size;
+    for (u32 i = 0; i < m_thread_count && pos < size; i++) {
+        auto& job = m_workers[i].job;
+        job.key = key;
+        job.ctr = ctr;
+        job.offset = offset + pos;
+        job.buf = data + pos;
+        job.size = std::min(part_size, size - pos);
+        job.pending = true;
+        pos += job.size;
+    }
+    condvarWakeAll(std::addressof(m_can_work));
+    mutexUnlock(std::addressof(m_mutex));
+
+    // the calling thread handles the first part.
+    Aes128Ctr(key, ctr, offset).Run(data, data, std::min(part_size, size));
+
+    SCOPED_MUTEX(std::addressof(m_mutex));
+    for (u32 i = 0; i < m_thread_count; i++) {
+        while (m_workers[i].job.pending) {
+            condvarWait(std::addressof(m_done), std::addressof(m_mutex));
+        }
+    }
+}
+
+void Aes128CtrPool::WorkerFunc(void* d) {
+    auto worker = static_cast<Worker*>(d);
+    auto pool = worker->pool;
+    auto& job = worker->job;
+
+    SCOPED_MUTEX(std::addressof(pool->m_mutex));
+    for (;;) {
+        while (!pool->m_quit && !job.pending) {
+            condvarWait(std::addressof(pool->m_can_work), std::addressof(pool->m_mutex));
+        }
+
+        if (pool->m_quit) {
+            break;
+        }
+
+        mutexUnlock(std::addressof(pool->m_mutex));
+        Aes128Ctr(job.key, job.ctr, job.offset).Run(job.buf, job.buf, job.size);
+        mutexLock(std::addressof(pool->m_mutex));
+
+        job.pending = false;
+        condvarWakeAll(std::addressof(pool->m_done));
+    }
+}
+
+} // namespace sphaira::crypto
@@ -1,8 +1,29 @@
 #include "yati/source/stream.hpp"
 #include "defines.hpp"
 #include "log.hpp"
+#include <algorithm>
 
 namespace sphaira::yati::source {
+namespace {
+
+// skipped data is read into this, rather than allocating the whole skip.
+constexpr s64 SKIP_BUFFER_SIZE = 1024 * 256;
+
+} // namespace
+
+Stream::~Stream() {
+    if (m_skip_count) {
+        log_write("[Stream] skipped %zd bytes in %u seeks\n", m_skipped_size, m_skip_count);
+    }
+}
+
+Result Stream::SkipChunk(s64 size, u64* bytes_skipped) {
+    if (m_skip_buf.empty()) {
+        m_skip_buf.resize(SKIP_BUFFER_SIZE);
+    }
+
+    return ReadChunk(m_skip_buf.data(), std::min<s64>(size, m_skip_buf.size()), bytes_skipped);
+}
 
 Result Stream::Read(void* _buf, s64 off, s64 size, u64* bytes_read_out) {
     // streams don't allow for random access (seeking backwards).
@@ -11,18 +32,21 @@ Result Stream::Read(void* _buf, s64 off, s64 size, u64* bytes_read_out) {
     auto buf = static_cast<u8*>(_buf);
     *bytes_read_out = 0;
 
+    if (off > m_offset) {
+        m_skipped_size += off - m_offset;
+        m_skip_count++;
+    }
+
     // check if we already have some data in the buffer.
     while (size) {
         // while it is invalid to seek backwards, it is valid to seek forwards.
         // this can be done to skip padding, skip undeeded files etc.
-        // to handle this, simply read the data into a buffer and discard it.
+        // to handle this, the data is skipped by the transport.
         if (off > m_offset) {
-            const auto skip_size = off - m_offset;
-            std::vector<u8> temp_buf(skip_size);
-            u64 bytes_read;
-            R_TRY(ReadChunk(temp_buf.data(), temp_buf.size(), &bytes_read));
+            u64 bytes_skipped;
+            R_TRY(SkipChunk(off - m_offset, &bytes_skipped));
 
-            m_offset += bytes_read;
+            m_offset += bytes_skipped;
         } else {
             u64 bytes_read;
             R_TRY(ReadChunk(buf, size, &bytes_read));
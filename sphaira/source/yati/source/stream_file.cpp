@@ -14,4 +14,11 @@ Result StreamFile::ReadChunk(void* buf, s64 size, u64* bytes_read) {
     return rc;
 }
 
+Result StreamFile::SkipChunk(s64 size, u64* bytes_skipped) {
+    R_TRY(GetOpenResult());
+    m_offset += size;
+    *bytes_skipped = size;
+    R_SUCCEED();
+}
+
 } // namespace sphaira::yati::source
@@ -4,12 +4,18 @@
 #include "usb/tinfoil.hpp"
 #include "log.hpp"
 #include <ranges>
+#include <algorithm>
+#include <cstring>
 
 namespace sphaira::yati::source {
 namespace {
 
 namespace tinfoil = usb::tinfoil;
 
+// every FILE_RANGE command costs a full round trip, so small sequential reads
+// are merged into a single larger request.
+constexpr s64 READ_AHEAD_SIZE = 1024 * 1024 * 8;
+
 } // namespace
 
 Usb::Usb(u64 transfer_timeout) {
@@ -49,6 +55,7 @@ Result Usb::WaitForConnection(u64 timeout, std::vector<std::string>& out_names)
 
 void Usb::SetFileNameForTranfser(const std::string& name) {
     m_transfer_file_name = name;
+    m_cache.clear();
 }
 
 Result Usb::SendCmdHeader(u32 cmdId, size_t dataSize, u64 timeout) {
@@ -90,9 +97,44 @@ bool Usb::IsStream() const {
 
 Result Usb::Read(void* buf, s64 off, s64 size, u64* bytes_read) {
     R_TRY(GetOpenResult());
+    *bytes_read = size;
+
+    auto dst = static_cast<u8*>(buf);
+    while (size) {
+        // serve what we can from the read ahead buffer.
+        const auto cache_end = m_cache_offset + (s64)m_cache.size();
+        if (off >= m_cache_offset && off < cache_end) {
+            const auto copy_size = std::min(size, cache_end - off);
+            std::memcpy(dst, m_cache.data() + (off - m_cache_offset), copy_size);
+            dst += copy_size;
+            off += copy_size;
+            size -= copy_size;
+            continue;
+        }
+
+        // only read ahead within the hinted range, as the host will not
+        // send any data past the end of the file.
+        const auto in_range = off >= m_read_ahead_offset && off + size <= m_read_ahead_end;
+        if (!in_range || size >= READ_AHEAD_SIZE) {
+            R_TRY(ReadRange(dst, off, size));
+            break;
+        }
+
+        const auto read_size = std::min(READ_AHEAD_SIZE, m_read_ahead_end - off);
+        m_cache.resize(read_size);
+        m_cache_offset = off;
+        if (const auto rc = ReadRange(m_cache.data(), off, read_size); R_FAILED(rc)) {
+            m_cache.clear();
+            R_THROW(rc);
+        }
+    }
+
+    R_SUCCEED();
+}
+
+Result Usb::ReadRange(void* buf, s64 off, s64 size) {
     R_TRY(SendFileRangeCmd(off, size, m_usb->GetTransferTimeout()));
     R_TRY(m_usb->TransferAll(true, buf, size));
-    *bytes_read = size;
     R_SUCCEED();
 }
 
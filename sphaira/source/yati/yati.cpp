@@ -13,6 +13,7 @@
 #include "yati/nx/crypto.hpp"
 
 #include "ui/progress_box.hpp"
+#include "ring_buf.hpp"
 #include "app.hpp"
 #include "i18n.hpp"
 #include "log.hpp"
@@ -20,6 +21,8 @@
 #include <zstd.h>
 #include <minIni.h>
 #include <algorithm>
+#include <atomic>
+#include <unordered_map>
 
 namespace sphaira::yati {
 namespace {
@@ -31,6 +34,16 @@ constexpr NcmStorageId NCM_STORAGE_IDS[]{
 
 constexpr u32 KEYGEN_LIMIT = 0x20;
 
+// stream installs can only use the ticket once it has been read, nca's
+// smaller than this that come before the ticket are held in memory and
+// installed once all tickets have been read.
+constexpr s64 STREAM_SPILL_MAX_SIZE = 1024 * 1024 * 4;
+// total memory used for the above.
+constexpr s64 STREAM_SPILL_BUDGET = 1024 * 1024 * 16;
+
+// max number of nca's installed at once, if the source allows for it.
+constexpr u32 NCA_INSTALL_LANES = 2;
+
 struct NcaCollection : container::CollectionEntry {
     nca::Header header{};
     // NcmContentType
@@ -73,145 +86,361 @@ struct TikCollection {
     bool patched{};
 };
 
+// installed content meta keys, per storage and application id.
+// the keys of an application are listed from the db on first use, and then
+// kept up to date as records are removed / pushed, so installing several
+// cnmt's of the same (or many) applications doesn't walk the db each time.
+struct MetaCache {
+    ~MetaCache() {
+        log_write("[META] db lists: %u cache hits: %u\n", m_list_count, m_hit_count);
+    }
+
+    Result GetKeys(NcmContentMetaDatabase* db, u32 storage, u64 app_id, std::vector<NcmContentMetaKey>& out) {
+        auto& map = m_keys[storage];
+        if (auto it = map.find(app_id); it != map.end()) {
+            m_hit_count++;
+            out = it->second;
+            R_SUCCEED();
+        }
+
+        s32 db_list_total;
+        s32 db_list_count;
+        std::vector<NcmContentMetaKey> keys(1);
+        R_TRY(ncmContentMetaDatabaseList(db, std::addressof(db_list_total), std::addressof(db_list_count), keys.data(), keys.size(), NcmContentMetaType_Unknown, app_id, 0, UINT64_MAX, NcmContentInstallType_Full));
+        m_list_count++;
+
+        if (db_list_total != keys.size()) {
+            keys.resize(db_list_total);
+            if (keys.size()) {
+                R_TRY(ncmContentMetaDatabaseList(db, std::addressof(db_list_total), std::addressof(db_list_count), keys.data(), keys.size(), NcmContentMetaType_Unknown, app_id, 0, UINT64_MAX, NcmContentInstallType_Full));
+                m_list_count++;
+            }
+        }
+
+        out = map[app_id] = keys;
+        R_SUCCEED();
+    }
+
+    Result Has(NcmContentMetaDatabase* db, u32 storage, const NcmContentMetaKey& key, bool& has) {
+        std::vector<NcmContentMetaKey> keys;
+        R_TRY(GetKeys(db, storage, ncm::GetAppId(key), keys));
+
+        has = std::ranges::any_of(keys, [&key](auto& e){
+            return IsSameKey(e, key);
+        });
+
+        R_SUCCEED();
+    }
+
+    // only updates applications that are already cached.
+    void Add(u32 storage, const NcmContentMetaKey& key) {
+        auto& map = m_keys[storage];
+        if (auto it = map.find(ncm::GetAppId(key)); it != map.end()) {
+            std::erase_if(it->second, [&key](auto& e){
+                return IsSameKey(e, key);
+            });
+            it->second.emplace_back(key);
+        }
+    }
+
+    void Remove(u32 storage, const NcmContentMetaKey& key) {
+        auto& map = m_keys[storage];
+        if (auto it = map.find(ncm::GetAppId(key)); it != map.end()) {
+            std::erase_if(it->second, [&key](auto& e){
+                return IsSameKey(e, key);
+            });
+        }
+    }
+
+private:
+    static bool IsSameKey(const NcmContentMetaKey& a, const NcmContentMetaKey& b) {
+        return a.id == b.id && a.version == b.version && a.type == b.type && a.install_type == b.install_type;
+    }
+
+private:
+    std::unordered_map<u64, std::vector<NcmContentMetaKey>> m_keys[std::size(NCM_STORAGE_IDS)]{};
+    u32 m_list_count{};
+    u32 m_hit_count{};
+};
+
+// shared by all installs whilst a Session is alive.
+Mutex g_meta_cache_mutex{};
+std::unique_ptr<MetaCache> g_meta_cache{};
+u32 g_session_count{};
+
 struct Yati;
 
 const u64 INFLATE_BUFFER_MAX = 1024*1024*4;
 
+// the buffers are swapped in / out of the ring, so entries only hold memory
+// once they've been used, entries past the ring depth never are.
 struct ThreadBuffer {
-    ThreadBuffer() {
-        buf.reserve(INFLATE_BUFFER_MAX);
-    }
-
     std::vector<u8> buf;
     s64 off;
 };
 
-template<std::size_t Size>
-struct RingBuf {
-private:
-    ThreadBuffer buf[Size]{};
-    unsigned r_index{};
-    unsigned w_index{};
+// ncz blocks are compressed independently of each other, so they can be
+// decompressed in parallel by a pool of workers, each with their own dctx.
+// the decompress thread collects the blocks in the same order they were submitted.
+constexpr u32 NCZ_BLOCK_THREADS = 3;
+// max number of blocks in flight, must be a power of 2.
+constexpr u32 NCZ_BLOCK_JOBS = 4;
+// blocks larger than this are streamed on the decompress thread instead.
+constexpr u64 NCZ_BLOCK_PARALLEL_MAX = 1024*1024*4;
+
+static_assert((NCZ_BLOCK_JOBS & (NCZ_BLOCK_JOBS - 1)) == 0, "Must be power of 2!");
+
+struct NczBlockJob {
+    Result Run(ZSTD_DCtx* dctx, u64 block_size) {
+        if (!compressed) {
+            std::swap(in, out);
+            R_SUCCEED();
+        }
 
-    static_assert((sizeof(RingBuf::buf) & (sizeof(RingBuf::buf) - 1)) == 0, "Must be power of 2!");
+        out.resize(block_size);
+        const auto res = ZSTD_decompressDCtx(dctx, out.data(), out.size(), in.data(), in.size());
+        if (ZSTD_isError(res)) {
+            log_write("[NCZ] ZSTD_decompressDCtx() size: %zu res: %zd msg: %s\n", in.size(), res, ZSTD_getErrorName(res));
+        }
+        R_UNLESS(!ZSTD_isError(res), Result_YatiInvalidNczZstdError);
 
-public:
-    void ringbuf_reset() {
-        this->r_index = this->w_index;
+        out.resize(res);
+        R_SUCCEED();
     }
 
-    unsigned ringbuf_capacity() const {
-        return sizeof(this->buf) / sizeof(this->buf[0]);
+    std::vector<u8> in{};
+    std::vector<u8> out{};
+    Result result{};
+    bool compressed{};
+    bool done{};
+};
+
+struct NczBlockPool {
+    NczBlockPool() {
+        mutexInit(std::addressof(mutex));
+        condvarInit(std::addressof(can_work));
+        condvarInit(std::addressof(can_pop));
     }
 
-    unsigned ringbuf_size() const {
-        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
+    ~NczBlockPool() {
+        Close();
     }
 
-    unsigned ringbuf_free() const {
-        return ringbuf_capacity() - ringbuf_size();
+    Result Create(u64 _block_size) {
+        block_size = _block_size;
+
+        for (u32 i = 0; i < NCZ_BLOCK_THREADS; i++) {
+            auto thread = std::addressof(threads[thread_count]);
+            R_TRY(threadCreate(thread, WorkerFunc, this, nullptr, 1024*64, PRIO_PREEMPTIVE, i));
+
+            if (const auto rc = threadStart(thread); R_FAILED(rc)) {
+                threadClose(thread);
+                R_THROW(rc);
+            }
+
+            thread_count++;
+        }
+
+        log_write("[NCZ] created block pool, threads: %u block_size: %zu\n", thread_count, block_size);
+        R_SUCCEED();
     }
 
-    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
-        auto& value = this->buf[this->w_index % ringbuf_capacity()];
-        value.off = off_in;
-        std::swap(value.buf, buf_in);
+    void Close() {
+        mutexLock(std::addressof(mutex));
+        quit = true;
+        condvarWakeAll(std::addressof(can_work));
+        mutexUnlock(std::addressof(mutex));
 
-        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
+        for (u32 i = 0; i < thread_count; i++) {
+            threadWaitForExit(std::addressof(threads[i]));
+            threadClose(std::addressof(threads[i]));
+        }
+
+        thread_count = 0;
     }
 
-    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
-        auto& value = this->buf[this->r_index % ringbuf_capacity()];
-        off_out = value.off;
-        std::swap(value.buf, buf_out);
+    auto IsEmpty() const -> bool {
+        return submit_index == pop_index;
+    }
 
-        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
+    auto IsFull() const -> bool {
+        return submit_index - pop_index == NCZ_BLOCK_JOBS;
     }
-};
 
-struct ThreadData {
-    ThreadData(Yati* _yati, std::span<TikCollection> _tik, NcaCollection* _nca)
-    : yati{_yati}, tik{_tik}, nca{_nca} {
-        mutexInit(std::addressof(read_mutex));
-        mutexInit(std::addressof(write_mutex));
-
-        condvarInit(std::addressof(can_read));
-        condvarInit(std::addressof(can_decompress));
-        condvarInit(std::addressof(can_decompress_write));
-        condvarInit(std::addressof(can_write));
-
-        sha256ContextCreate(&sha256);
-        // this will be updated with the actual size from nca header.
-        write_size = nca->size;
-
-        // reduce buffer size to preve
-        if (App::IsFileBaseEmummc()) {
-            read_buffer_size = 1024 * 512;
-        } else {
-            read_buffer_size = 1024*1024*4;
+    // returns true if the oldest block has finished.
+    auto IsReady() -> bool {
+        SCOPED_MUTEX(std::addressof(mutex));
+        return !IsEmpty() && jobs[pop_index % NCZ_BLOCK_JOBS].done;
+    }
+
+    // the pool must not be full, the input buffer is swapped with an unused buffer.
+    void Submit(std::vector<u8>& in, bool compressed) {
+        SCOPED_MUTEX(std::addressof(mutex));
+
+        auto& job = jobs[submit_index % NCZ_BLOCK_JOBS];
+        std::swap(job.in, in);
+        job.compressed = compressed;
+        job.result = 0;
+        job.done = false;
+
+        submit_index++;
+        condvarWakeOne(std::addressof(can_work));
+    }
+
+    // blocks until the oldest block has finished, the output buffer is swapped.
+    Result Pop(std::vector<u8>& out) {
+        SCOPED_MUTEX(std::addressof(mutex));
+
+        auto& job = jobs[pop_index % NCZ_BLOCK_JOBS];
+        while (!job.done) {
+            condvarWait(std::addressof(can_pop), std::addressof(mutex));
         }
 
-        max_buffer_size = std::max(read_buffer_size, INFLATE_BUFFER_MAX);
+        pop_index++;
+        std::swap(job.out, out);
+        return job.result;
+    }
+
+private:
+    static void WorkerFunc(void* d) {
+        auto pool = static_cast<NczBlockPool*>(d);
+        auto dctx = ZSTD_createDCtx();
+        ON_SCOPE_EXIT(ZSTD_freeDCtx(dctx));
+
+        SCOPED_MUTEX(std::addressof(pool->mutex));
+        for (;;) {
+            while (!pool->quit && pool->work_index == pool->submit_index) {
+                condvarWait(std::addressof(pool->can_work), std::addressof(pool->mutex));
+            }
+
+            if (pool->quit) {
+                break;
+            }
+
+            auto& job = pool->jobs[pool->work_index++ % NCZ_BLOCK_JOBS];
+
+            mutexUnlock(std::addressof(pool->mutex));
+            const auto rc = dctx ? job.Run(dctx, pool->block_size) : Result_YatiInvalidNczZstdError;
+            mutexLock(std::addressof(pool->mutex));
+
+            job.result = rc;
+            job.done = true;
+            condvarWakeAll(std::addressof(pool->can_pop));
+        }
+    }
+
+private:
+    Mutex mutex{};
+    CondVar can_work{};
+    CondVar can_pop{};
+
+    NczBlockJob jobs[NCZ_BLOCK_JOBS]{};
+    u32 submit_index{};
+    u32 work_index{};
+    u32 pop_index{};
+
+    Thread threads[NCZ_BLOCK_THREADS]{};
+    u32 thread_count{};
+    u64 block_size{};
+    bool quit{};
+};
+
+// pipeline stages, used for timing each thread.
+enum Stage {
+    Stage_Read,
+    Stage_Decompress,
+    Stage_Hash,
+    Stage_Write,
+    Stage_Max,
+};
+
+struct StageTimer {
+    // total time the stage was running for.
+    u64 total_ticks{};
+    // time spent waiting on another stage to push / pop a buffer.
+    u64 wait_ticks{};
+};
+
+// adds the time elapsed in the current scope to the counter.
+struct ScopedTicks {
+    ScopedTicks(u64& out) : m_out{out}, m_start{armGetSystemTick()} { }
+    ~ScopedTicks() {
+        m_out += armGetSystemTick() - m_start;
     }
 
+private:
+    u64& m_out;
+    const u64 m_start;
+};
+
+using BufferRing = RingBuf<ThreadBuffer, 4>;
+
+struct ThreadData {
+    ThreadData(Yati* _yati, std::span<TikCollection> _tik, NcaCollection* _nca);
+
     auto GetResults() -> Result;
     void WakeAllThreads();
 
     Result Read(void* buf, s64 size, u64* bytes_read);
 
-    Result SetDecompressBuf(std::vector<u8>& buf, s64 off, s64 size) {
+    Result PushBuf(BufferRing& ring, std::vector<u8>& buf, s64 off, s64 size) {
         buf.resize(size);
+        return ring.Push([&](ThreadBuffer& e) {
+            std::swap(e.buf, buf);
+            e.off = off;
+        }, [this]() {
+            return GetResults();
+        });
+    }
 
-        mutexLock(std::addressof(read_mutex));
-        if (!read_buffers.ringbuf_free()) {
-            R_TRY(condvarWait(std::addressof(can_read), std::addressof(read_mutex)));
-        }
+    Result PopBuf(BufferRing& ring, std::vector<u8>& buf_out, s64& off_out) {
+        R_TRY(ring.Pop([&](ThreadBuffer& e) {
+            std::swap(e.buf, buf_out);
+            off_out = e.off;
+        }, [this]() {
+            return GetResults();
+        }));
 
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(read_mutex)));
-        R_TRY(GetResults());
-        read_buffers.ringbuf_push(buf, off);
-        return condvarWakeOne(std::addressof(can_decompress));
+        return GetResults();
     }
 
-    Result GetDecompressBuf(std::vector<u8>& buf_out, s64& off_out) {
-        mutexLock(std::addressof(read_mutex));
-        if (!read_buffers.ringbuf_size()) {
-            R_TRY(condvarWait(std::addressof(can_decompress), std::addressof(read_mutex)));
-        }
+    Result SetDecompressBuf(std::vector<u8>& buf, s64 off, s64 size) {
+        ScopedTicks ticks{timers[Stage_Read].wait_ticks};
+        return PushBuf(read_buffers, buf, off, size);
+    }
 
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(read_mutex)));
-        R_TRY(GetResults());
-        read_buffers.ringbuf_pop(buf_out, off_out);
-        return condvarWakeOne(std::addressof(can_read));
+    Result GetDecompressBuf(std::vector<u8>& buf_out, s64& off_out) {
+        ScopedTicks ticks{timers[Stage_Decompress].wait_ticks};
+        return PopBuf(read_buffers, buf_out, off_out);
     }
 
-    Result SetWriteBuf(std::vector<u8>& buf, s64 size, bool skip_verify) {
-        buf.resize(size);
-        if (!skip_verify) {
-            sha256ContextUpdate(std::addressof(sha256), buf.data(), buf.size());
-        }
+    Result SetHashBuf(std::vector<u8>& buf, s64 size) {
+        ScopedTicks ticks{timers[Stage_Decompress].wait_ticks};
+        return PushBuf(hash_buffers, buf, 0, size);
+    }
 
-        mutexLock(std::addressof(write_mutex));
-        if (!write_buffers.ringbuf_free()) {
-            R_TRY(condvarWait(std::addressof(can_decompress_write), std::addressof(write_mutex)));
-        }
+    Result GetHashBuf(std::vector<u8>& buf_out, s64& off_out) {
+        ScopedTicks ticks{timers[Stage_Hash].wait_ticks};
+        return PopBuf(hash_buffers, buf_out, off_out);
+    }
 
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(write_mutex)));
-        R_TRY(GetResults());
-        write_buffers.ringbuf_push(buf, 0);
-        return condvarWakeOne(std::addressof(can_write));
+    Result SetWriteBuf(std::vector<u8>& buf, s64 size) {
+        ScopedTicks ticks{timers[Stage_Hash].wait_ticks};
+        return PushBuf(write_buffers, buf, 0, size);
     }
 
     Result GetWriteBuf(std::vector<u8>& buf_out, s64& off_out) {
-        mutexLock(std::addressof(write_mutex));
-        if (!write_buffers.ringbuf_size()) {
-            R_TRY(condvarWait(std::addressof(can_write), std::addressof(write_mutex)));
-        }
+        ScopedTicks ticks{timers[Stage_Write].wait_ticks};
+        return PopBuf(write_buffers, buf_out, off_out);
+    }
 
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(write_mutex)));
-        R_TRY(GetResults());
-        write_buffers.ringbuf_pop(buf_out, off_out);
-        return condvarWakeOne(std::addressof(can_decompress_write));
+    void LogStats() const {
+        static const char* names[Stage_Max]{ "read", "decompress", "hash", "write" };
+        for (u32 i = 0; i < Stage_Max; i++) {
+            const auto total_ms = armTicksToNs(timers[i].total_ticks) / 1000000;
+            const auto wait_ms = armTicksToNs(timers[i].wait_ticks) / 1000000;
+            log_write("[STATS] %s: total: %lu ms wait: %lu ms busy: %lu ms\n", names[i], total_ms, wait_ms, total_ms - std::min(total_ms, wait_ms));
+        }
     }
 
     // these need to be copied
@@ -220,22 +449,16 @@ struct ThreadData {
     NcaCollection* nca{};
 
     // these need to be created
-    Mutex read_mutex{};
-    Mutex write_mutex{};
-
-    CondVar can_read{};
-    CondVar can_decompress{};
-    CondVar can_decompress_write{};
-    CondVar can_write{};
-
-    RingBuf<4> read_buffers{};
-    RingBuf<4> write_buffers{};
+    BufferRing read_buffers{};
+    BufferRing hash_buffers{};
+    BufferRing write_buffers{};
 
     ncz::BlockHeader ncz_block_header{};
     std::vector<ncz::Section> ncz_sections{};
     std::vector<ncz::BlockInfo> ncz_blocks{};
 
     Sha256Context sha256{};
+    StageTimer timers[Stage_Max]{};
 
     u64 read_buffer_size{};
     u64 max_buffer_size{};
@@ -243,11 +466,13 @@ struct ThreadData {
     // these are shared between threads
     volatile s64 read_offset{};
     volatile s64 decompress_offset{};
+    volatile s64 hash_offset{};
     volatile s64 write_offset{};
     volatile s64 write_size{};
 
     volatile Result read_result{};
     volatile Result decompress_result{};
+    volatile Result hash_result{};
     volatile Result write_result{};
 };
 
@@ -256,12 +481,19 @@ struct Yati {
     ~Yati();
 
     Result Setup(const ConfigOverride& override);
-    Result InstallNca(std::span<TikCollection> tickets, NcaCollection& nca);
-    Result InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection& nca);
+    // if progress is set, the read offset is stored there rather than
+    // updating the progress box.
+    Result InstallNca(std::span<TikCollection> tickets, NcaCollection& nca, std::atomic<s64>* progress = nullptr);
+    Result InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection& nca, std::atomic<s64>* progress);
+    // sets the title and icon from the control nca.
+    Result ShowNcaInfo(const NcaCollection& nca);
+    // installs the nca's, several at once if the source allows for it.
+    Result InstallNcas(std::span<TikCollection> tickets, std::span<NcaCollection> ncas);
     Result InstallCnmtNca(std::span<TikCollection> tickets, CnmtCollection& cnmt, const container::Collections& collections);
 
     Result readFuncInternal(ThreadData* t);
     Result decompressFuncInternal(ThreadData* t);
+    Result hashFuncInternal(ThreadData* t);
     Result writeFuncInternal(ThreadData* t);
 
     Result ParseTicketsIntoCollection(std::vector<TikCollection>& tickets, const container::Collections& collections, bool read_data);
@@ -288,24 +520,57 @@ struct Yati {
     std::unique_ptr<container::Base> container{};
     Config config{};
     keys::Keys keys{};
+
+    // number of nca's being installed at once.
+    u32 nca_lanes{1};
+    // locked whilst the nca's update the ticket collection.
+    Mutex ticket_mutex{};
+
+    // points to either the session cache or the one owned below.
+    MetaCache* meta_cache{};
+    std::unique_ptr<MetaCache> owned_meta_cache{};
 };
 
+ThreadData::ThreadData(Yati* _yati, std::span<TikCollection> _tik, NcaCollection* _nca)
+: yati{_yati}, tik{_tik}, nca{_nca} {
+    sha256ContextCreate(&sha256);
+    // this will be updated with the actual size from nca header.
+    write_size = nca->size;
+
+    // reduce buffer size to preve
+    if (App::IsFileBaseEmummc()) {
+        read_buffer_size = 1024 * 512;
+    } else {
+        read_buffer_size = 1024*1024*4;
+    }
+
+    // the memory is shared between the nca's installed at once.
+    read_buffer_size /= yati->nca_lanes;
+    read_buffers.SetDepth(BufferRing::Capacity() / yati->nca_lanes);
+    hash_buffers.SetDepth(BufferRing::Capacity() / yati->nca_lanes);
+    write_buffers.SetDepth(BufferRing::Capacity() / yati->nca_lanes);
+
+    // ncz's are never installed at once, so the inflate buffer isn't needed.
+    if (yati->nca_lanes > 1) {
+        max_buffer_size = read_buffer_size;
+    } else {
+        max_buffer_size = std::max(read_buffer_size, INFLATE_BUFFER_MAX);
+    }
+}
+
 auto ThreadData::GetResults() -> Result {
     R_TRY(yati->pbox->ShouldExitResult());
     R_TRY(read_result);
     R_TRY(decompress_result);
+    R_TRY(hash_result);
     R_TRY(write_result);
     R_SUCCEED();
 }
 
 void ThreadData::WakeAllThreads() {
-    condvarWakeAll(std::addressof(can_read));
-    condvarWakeAll(std::addressof(can_decompress));
-    condvarWakeAll(std::addressof(can_decompress_write));
-    condvarWakeAll(std::addressof(can_write));
-
-    mutexUnlock(std::addressof(read_mutex));
-    mutexUnlock(std::addressof(write_mutex));
+    read_buffers.WakeAll();
+    hash_buffers.WakeAll();
+    write_buffers.WakeAll();
 }
 
 Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
@@ -370,6 +635,7 @@ Result HasRequiredTicket(const nca::Header& header, std::span<TikCollection> tik
 // read thread reads all data from the source, it also handles
 // parsing ncz headers, sections and reading ncz blocks
 Result Yati::readFuncInternal(ThreadData* t) {
+    ScopedTicks ticks{t->timers[Stage_Read].total_ticks};
     // the main buffer which data is read into.
     std::vector<u8> buf;
     // workaround ncz block reading ahead. if block isn't found, we usually
@@ -415,6 +681,9 @@ Result Yati::readFuncInternal(ThreadData* t) {
                 t->ncz_sections.resize(header.total_sections);
                 R_TRY(t->Read(t->ncz_sections.data(), t->ncz_sections.size() * sizeof(ncz::Section), std::addressof(bytes_read)));
 
+                // sort once so that sections can be binary searched whilst decompressing.
+                std::ranges::sort(t->ncz_sections, std::ranges::less{}, &ncz::Section::offset);
+
                 // check for ncz block header.
                 R_TRY(t->Read(std::addressof(t->ncz_block_header), sizeof(t->ncz_block_header), std::addressof(bytes_read)));
                 if (t->ncz_block_header.magic != NCZ_BLOCK_MAGIC) {
@@ -433,7 +702,7 @@ Result Yati::readFuncInternal(ThreadData* t) {
                     std::vector<ncz::Block> blocks(t->ncz_block_header.total_blocks);
                     R_TRY(t->Read(blocks.data(), blocks.size() * sizeof(ncz::Block), std::addressof(bytes_read)));
 
-                    // calculate offsets for each block.
+                    // calculate offsets for each block, these are sorted by offset.
                     auto block_offset = t->read_offset;
                     for (const auto& block : blocks) {
                         t->ncz_blocks.emplace_back(block_offset, block.size);
@@ -451,8 +720,10 @@ Result Yati::readFuncInternal(ThreadData* t) {
 }
 
 // decompress thread handles decrypting / modifying the nca header, decompressing ncz
-// and calculating the running sha256.
+// and re-encrypting the ncz sections.
 Result Yati::decompressFuncInternal(ThreadData* t) {
+    ScopedTicks ticks{t->timers[Stage_Decompress].total_ticks};
+
     // only used for ncz files.
     auto dctx = ZSTD_createDCtx();
     ON_SCOPE_EXIT(ZSTD_freeDCtx(dctx));
@@ -462,7 +733,8 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
     bool is_ncz{};
 
     s64 inflate_offset{};
-    Aes128CtrContext ctx{};
+    // only created once a section needs re-encrypting.
+    crypto::Aes128CtrPool ctr_pool{};
     std::vector<u8> inflate_buf{};
     inflate_buf.reserve(t->max_buffer_size);
 
@@ -471,6 +743,12 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
     std::vector<u8> buf{};
     buf.reserve(t->max_buffer_size);
 
+    // only used for ncz files with blocks small enough to decompress in parallel.
+    NczBlockPool block_pool{};
+    bool use_block_pool{};
+    std::vector<u8> block_buf{};
+    std::vector<u8> block_out{};
+
     // encrypts the nca and passes the buffer to the write thread.
     const auto ncz_flush = [&](s64 size) -> Result {
         if (!inflate_offset) {
@@ -490,20 +768,16 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
         for (s64 off = 0; off < size;) {
             if (!ncz_section || !ncz_section->InRange(written)) {
                 log_write("[NCZ] looking for new section: %zu\n", written);
-                auto it = std::ranges::find_if(t->ncz_sections, [written](auto& e){
-                    return e.InRange(written);
-                });
-
-                R_UNLESS(it != t->ncz_sections.cend(), Result_YatiNczSectionNotFound);
-                ncz_section = &(*it);
+                ncz_section = ncz::FindInRange<ncz::Section>(t->ncz_sections, written, ncz_section);
+                R_UNLESS(ncz_section, Result_YatiNczSectionNotFound);
                 log_write("[NCZ] found new section: %zu\n", written);
 
-                if (ncz_section->crypto_type >= nca::EncryptionType_AesCtr) {
-                    const auto swp = std::byteswap(u64(written) >> 4);
-                    u8 counter[0x16];
-                    std::memcpy(counter + 0x0, ncz_section->counter, 0x8);
-                    std::memcpy(counter + 0x8, &swp, 0x8);
-                    aes128CtrContextCreate(&ctx, ncz_section->key, counter);
+                if (ncz_section->crypto_type >= nca::EncryptionType_AesCtr && !ctr_pool.IsCreated()) {
+                    // not fatal, the pool falls back to this thread.
+                    if (R_FAILED(ctr_pool.Create())) {
+                        log_write("[NCZ] failed to create ctr pool\n");
+                        ctr_pool.Close();
+                    }
                 }
             }
 
@@ -511,14 +785,14 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
             const auto chunk_size = std::min<u64>(total_size - written, size - off);
 
             if (ncz_section->crypto_type >= nca::EncryptionType_AesCtr) {
-                aes128CtrCrypt(&ctx, inflate_buf.data() + off, inflate_buf.data() + off, chunk_size);
+                ctr_pool.Run(ncz_section->key, ncz_section->counter, written, inflate_buf.data() + off, chunk_size);
             }
 
             written += chunk_size;
             off += chunk_size;
         }
 
-        R_TRY(t->SetWriteBuf(inflate_buf, size, config.skip_nca_hash_verify));
+        R_TRY(t->SetHashBuf(inflate_buf, size));
         inflate_offset -= size;
 
         // restore remaining data to the swapped buffer.
@@ -530,6 +804,23 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
         R_SUCCEED();
     };
 
+    // collects the oldest decompressed block from the pool.
+    const auto ncz_pop_block = [&]() -> Result {
+        R_TRY(block_pool.Pop(block_out));
+
+        inflate_buf.resize(inflate_offset + block_out.size());
+        std::memcpy(inflate_buf.data() + inflate_offset, block_out.data(), block_out.size());
+
+        t->decompress_offset += block_out.size();
+        inflate_offset += block_out.size();
+        if (inflate_offset >= INFLATE_BUFFER_MAX) {
+            log_write("[NCZ] flushing block data\n");
+            R_TRY(ncz_flush(INFLATE_BUFFER_MAX));
+        }
+
+        R_SUCCEED();
+    };
+
     while (t->decompress_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
         s64 decompress_buf_off{};
         R_TRY(t->GetDecompressBuf(buf, decompress_buf_off));
@@ -538,6 +829,20 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
         if (!is_ncz && !t->ncz_sections.empty()) {
             log_write("YES IT FOUND NCZ\n");
             is_ncz = true;
+
+            const auto block_size = 1ULL << t->ncz_block_header.block_size_exponent;
+            // the pool isn't used in applet mode due to the extra memory,
+            // and isn't fatal if it fails to start, blocks are then streamed.
+            if (!t->ncz_blocks.empty() && block_size <= NCZ_BLOCK_PARALLEL_MAX && !App::IsApplet()) {
+                if (R_SUCCEEDED(block_pool.Create(block_size))) {
+                    block_buf.reserve(block_size);
+                    block_out.reserve(block_size);
+                    use_block_pool = true;
+                } else {
+                    log_write("[NCZ] failed to create block pool\n");
+                    block_pool.Close();
+                }
+            }
         }
 
         // if we don't have a ncz or it's before the ncz header, pass buffer directly to write
@@ -573,6 +878,7 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                 }
 
                 // try and get the ticket, if the nca requires it.
+                SCOPED_MUTEX(&ticket_mutex);
                 auto ticket = GetTicketCollection(header, t->tik);
                 R_TRY(HasRequiredTicket(header, ticket));
 
@@ -620,7 +926,7 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
 
             written += buf.size();
             t->decompress_offset += buf.size();
-            R_TRY(t->SetWriteBuf(buf, buf.size(), config.skip_nca_hash_verify));
+            R_TRY(t->SetHashBuf(buf, buf.size()));
         } else if (is_ncz) {
             u64 buf_off{};
             while (buf_off < buf.size()) {
@@ -632,21 +938,19 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                     if (!ncz_block || !ncz_block->InRange(decompress_buf_off)) {
                         block_offset = 0;
                         log_write("[NCZ] looking for new block: %zu\n", decompress_buf_off);
-                        auto it = std::ranges::find_if(t->ncz_blocks, [decompress_buf_off](auto& e){
-                            return e.InRange(decompress_buf_off);
-                        });
-
-                        R_UNLESS(it != t->ncz_blocks.cend(), Result_YatiNczBlockNotFound);
-                        log_write("[NCZ] found new block: %zu off: %zd size: %zd\n", decompress_buf_off, it->offset, it->size);
-                        ncz_block = &(*it);
+                        ncz_block = ncz::FindInRange<ncz::BlockInfo>(t->ncz_blocks, decompress_buf_off, ncz_block);
+                        R_UNLESS(ncz_block, Result_YatiNczBlockNotFound);
+                        log_write("[NCZ] found new block: %zu off: %zd size: %zd\n", decompress_buf_off, ncz_block->offset, ncz_block->size);
                     }
 
                     // https://github.com/nicoboss/nsz/issues/79
-                    auto decompressedBlockSize = 1 << t->ncz_block_header.block_size_exponent;
+                    auto decompressedBlockSize = 1ULL << t->ncz_block_header.block_size_exponent;
                     // special handling for the last block to check it's actually compressed
                     if (ncz_block->offset == t->ncz_blocks.back().offset) {
                         log_write("[NCZ] last block special handling\n");
-                        decompressedBlockSize = t->ncz_block_header.decompressed_size % decompressedBlockSize;
+                        if (const auto remainder = t->ncz_block_header.decompressed_size % decompressedBlockSize) {
+                            decompressedBlockSize = remainder;
+                        }
                     }
 
                     // check if this block is compressed.
@@ -657,7 +961,31 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                     buffer = buffer.subspan(0, size);
                 }
 
-                if (compressed) {
+                if (use_block_pool) {
+                    // gather the entire block before passing it to the pool.
+                    block_buf.insert(block_buf.end(), buffer.begin(), buffer.end());
+
+                    if (block_offset + buffer.size() == ncz_block->size) {
+                        if (block_pool.IsFull()) {
+                            R_TRY(ncz_pop_block());
+                        }
+
+                        block_pool.Submit(block_buf, compressed);
+                        block_buf.clear();
+
+                        // collect any blocks that have already finished.
+                        while (block_pool.IsReady()) {
+                            R_TRY(ncz_pop_block());
+                        }
+
+                        // no more blocks will be submitted, so wait for the rest.
+                        if (ncz_block == std::addressof(t->ncz_blocks.back())) {
+                            while (!block_pool.IsEmpty()) {
+                                R_TRY(ncz_pop_block());
+                            }
+                        }
+                    }
+                } else if (compressed) {
                     log_write("[NCZ] COMPRESSED block\n");
                     ZSTD_inBuffer input = { buffer.data(), buffer.size(), 0 };
                     while (input.pos < input.size) {
@@ -704,15 +1032,38 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
     }
 
     log_write("decompress thread done!\n");
+    R_SUCCEED();
+}
+
+// hash thread calculates the running sha256, this is done on its own thread
+// as to not slow down the decompress thread.
+Result Yati::hashFuncInternal(ThreadData* t) {
+    ScopedTicks ticks{t->timers[Stage_Hash].total_ticks};
+    std::vector<u8> buf;
+    buf.reserve(t->max_buffer_size);
+
+    while (t->hash_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
+        s64 dummy_off;
+        R_TRY(t->GetHashBuf(buf, dummy_off));
+
+        if (!config.skip_nca_hash_verify) {
+            sha256ContextUpdate(std::addressof(t->sha256), buf.data(), buf.size());
+        }
+
+        t->hash_offset += buf.size();
+        R_TRY(t->SetWriteBuf(buf, buf.size()));
+    }
 
     // get final hash output.
     sha256ContextGetHash(std::addressof(t->sha256), t->nca->hash);
 
+    log_write("hash thread done!\n");
     R_SUCCEED();
 }
 
 // write thread writes data to the nca placeholder.
 Result Yati::writeFuncInternal(ThreadData* t) {
+    ScopedTicks ticks{t->timers[Stage_Write].total_ticks};
     std::vector<u8> buf;
     buf.reserve(t->max_buffer_size);
     const auto is_file_based_emummc = App::IsFileBaseEmummc();
@@ -755,6 +1106,12 @@ void decompressFunc(void* d) {
     log_write("decompress thread returned now\n");
 }
 
+void hashFunc(void* d) {
+    auto t = static_cast<ThreadData*>(d);
+    t->hash_result = t->yati->hashFuncInternal(t);
+    log_write("hash thread returned now\n");
+}
+
 void writeFunc(void* d) {
     auto t = static_cast<ThreadData*>(d);
     t->write_result = t->yati->writeFuncInternal(t);
@@ -845,11 +1202,21 @@ Result Yati::Setup(const ConfigOverride& override) {
     cs = ncm_cs[config.sd_card_install];
     db = ncm_db[config.sd_card_install];
 
+    {
+        SCOPED_MUTEX(std::addressof(g_meta_cache_mutex));
+        meta_cache = g_meta_cache.get();
+    }
+
+    if (!meta_cache) {
+        owned_meta_cache = std::make_unique<MetaCache>();
+        meta_cache = owned_meta_cache.get();
+    }
+
     R_TRY(parse_keys(keys, true));
     R_SUCCEED();
 }
 
-Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection& nca) {
+Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection& nca, std::atomic<s64>* progress) {
     if (config.skip_if_already_installed || config.ticket_only) {
         R_TRY(ncmContentStorageHas(std::addressof(cs), std::addressof(nca.skipped), std::addressof(nca.content_id)));
         if (nca.skipped) {
@@ -857,6 +1224,7 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
             R_TRY(ncmContentStorageReadContentIdFile(std::addressof(cs), std::addressof(nca.header), sizeof(nca.header), std::addressof(nca.content_id), 0));
             crypto::cryptoAes128Xts(std::addressof(nca.header), std::addressof(nca.header), keys.header_key, 0, 0x200, sizeof(nca.header), false);
 
+            SCOPED_MUTEX(&ticket_mutex);
             R_TRY(HasRequiredTicket(nca.header, tickets));
             R_SUCCEED();
         }
@@ -870,11 +1238,16 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     log_write("opening thread\n");
     ThreadData t_data{this, tickets, std::addressof(nca)};
 
+    // read and write mostly block on fs / usb ipc, so the cpu heavy stages
+    // are paired with them rather than each other. the write thread shares
+    // core 0 with the ncm placeholder writes, so hashing goes with read.
     #define READ_THREAD_CORE 1
     #define DECOMPRESS_THREAD_CORE 2
+    #define HASH_THREAD_CORE 1
     #define WRITE_THREAD_CORE 0
     // #define READ_THREAD_CORE 2
     // #define DECOMPRESS_THREAD_CORE 2
+    // #define HASH_THREAD_CORE 2
     // #define WRITE_THREAD_CORE 2
 
     Thread t_read{};
@@ -885,10 +1258,18 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     R_TRY(threadCreate(&t_decompress, decompressFunc, std::addressof(t_data), nullptr, 1024*64, PRIO_PREEMPTIVE, DECOMPRESS_THREAD_CORE));
     ON_SCOPE_EXIT(threadClose(&t_decompress));
 
+    Thread t_hash{};
+    R_TRY(threadCreate(&t_hash, hashFunc, std::addressof(t_data), nullptr, 1024*64, PRIO_PREEMPTIVE, HASH_THREAD_CORE));
+    ON_SCOPE_EXIT(threadClose(&t_hash));
+
     Thread t_write{};
     R_TRY(threadCreate(&t_write, writeFunc, std::addressof(t_data), nullptr, 1024*64, PRIO_PREEMPTIVE, WRITE_THREAD_CORE));
     ON_SCOPE_EXIT(threadClose(&t_write));
 
+    // the read thread reads the nca sequentially.
+    source->SetReadAheadRange(nca.offset, nca.size);
+    ON_SCOPE_EXIT(source->SetReadAheadRange(0, 0));
+
     log_write("starting threads\n");
     R_TRY(threadStart(std::addressof(t_read)));
     ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_read)));
@@ -896,11 +1277,18 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     R_TRY(threadStart(std::addressof(t_decompress)));
     ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_decompress)));
 
+    R_TRY(threadStart(std::addressof(t_hash)));
+    ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_hash)));
+
     R_TRY(threadStart(std::addressof(t_write)));
     ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_write)));
 
     while (t_data.write_offset != t_data.write_size && R_SUCCEEDED(t_data.GetResults())) {
-        pbox->UpdateTransfer(t_data.write_offset, t_data.write_size);
+        if (progress) {
+            *progress = t_data.read_offset;
+        } else {
+            pbox->UpdateTransfer(t_data.write_offset, t_data.write_size);
+        }
         svcSleepThread(1e+6);
     }
 
@@ -908,18 +1296,26 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     log_write("waiting for threads to close\n");
     for (;;) {
         t_data.WakeAllThreads();
-        pbox->Yield();
+        // lanes don't own the progress box.
+        if (progress) {
+            svcSleepThread(YieldType_WithoutCoreMigration);
+        } else {
+            pbox->Yield();
+        }
 
         if (R_FAILED(waitSingleHandle(t_read.handle, 1000))) {
             continue;
         } else if (R_FAILED(waitSingleHandle(t_decompress.handle, 1000))) {
             continue;
+        } else if (R_FAILED(waitSingleHandle(t_hash.handle, 1000))) {
+            continue;
         } else if (R_FAILED(waitSingleHandle(t_write.handle, 1000))) {
             continue;
         }
         break;
     }
     log_write("threads closed\n");
+    t_data.LogStats();
 
     // if any of the threads failed, wake up all threads so they can exit.
     if (R_FAILED(t_data.GetResults())) {
@@ -947,30 +1343,187 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     R_SUCCEED();
 }
 
-Result Yati::InstallNca(std::span<TikCollection> tickets, NcaCollection& nca) {
+Result Yati::InstallNca(std::span<TikCollection> tickets, NcaCollection& nca, std::atomic<s64>* progress) {
     log_write("in install nca\n");
-    pbox->NewTransfer(nca.name);
+    if (!progress) {
+        pbox->NewTransfer(nca.name);
+    }
     keys::parse_hex_key(std::addressof(nca.content_id), nca.name.c_str());
 
-    R_TRY(InstallNcaInternal(tickets, nca));
+    R_TRY(InstallNcaInternal(tickets, nca, progress));
+
+    if (!nca.skipped) {
+        R_TRY(ncmContentStorageFlushPlaceHolder(std::addressof(cs)));
+    }
+
+    // the progress box is only updated from the thread that owns it, so
+    // InstallNcas() does this once the lanes have finished.
+    if (!progress) {
+        R_TRY(ShowNcaInfo(nca));
+    }
+
+    R_SUCCEED();
+}
+
+Result Yati::ShowNcaInfo(const NcaCollection& nca) {
+    // todo: verify npdm key of program nca's.
+    if (nca.header.content_type != nca::ContentType_Control) {
+        R_SUCCEED();
+    }
 
     fs::FsPath path;
     if (nca.skipped) {
         R_TRY(ncmContentStorageGetPath(std::addressof(cs), path, sizeof(path), std::addressof(nca.content_id)));
     } else {
-        R_TRY(ncmContentStorageFlushPlaceHolder(std::addressof(cs)));
         R_TRY(ncmContentStorageGetPlaceHolderPath(std::addressof(cs), path, sizeof(path), std::addressof(nca.placeholder_id)));
     }
 
-    if (nca.header.content_type == nca::ContentType_Program) {
-        // todo: verify npdm key.
-    } else if (nca.header.content_type == nca::ContentType_Control) {
-        NacpLanguageEntry entry;
-        std::vector<u8> icon;
-        // this may fail if tickets aren't installed and the nca uses title key crypto.
-        if (R_SUCCEEDED(nca::ParseControl(path, nca.header.program_id, &entry, sizeof(entry), &icon))) {
-            pbox->SetTitle(entry.name).SetImageData(icon);
+    NacpLanguageEntry entry;
+    std::vector<u8> icon;
+    // this may fail if tickets aren't installed and the nca uses title key crypto.
+    if (R_SUCCEEDED(nca::ParseControl(path, nca.header.program_id, &entry, sizeof(entry), &icon))) {
+        pbox->SetTitle(entry.name).SetImageData(icon);
+    }
+
+    R_SUCCEED();
+}
+
+struct NcaLanes;
+
+struct NcaLane {
+    NcaLanes* parent{};
+    Thread thread{};
+    // read offset of the nca being installed.
+    std::atomic<s64> progress{};
+    volatile Result result{};
+};
+
+// installs nca's from a shared queue, each lane installs one nca at a time.
+struct NcaLanes {
+    auto GetResults() -> Result {
+        R_TRY(yati->pbox->ShouldExitResult());
+        R_UNLESS(!cancel, Result_TransferCancelled);
+        for (const auto& lane : lanes) {
+            R_TRY(lane.result);
+        }
+        R_SUCCEED();
+    }
+
+    Yati* yati{};
+    std::span<TikCollection> tickets{};
+    std::span<NcaCollection> ncas{};
+
+    NcaLane lanes[NCA_INSTALL_LANES]{};
+    std::atomic<u32> next{};
+    // size of the nca's that have finished.
+    std::atomic<s64> done{};
+    volatile bool cancel{};
+};
+
+void ncaLaneFunc(void* d) {
+    auto lane = static_cast<NcaLane*>(d);
+    auto parent = lane->parent;
+
+    while (R_SUCCEEDED(parent->GetResults())) {
+        const auto index = parent->next++;
+        if (index >= parent->ncas.size()) {
+            break;
+        }
+
+        auto& nca = parent->ncas[index];
+        lane->progress = 0;
+        lane->result = parent->yati->InstallNca(parent->tickets, nca, std::addressof(lane->progress));
+        lane->progress = 0;
+        parent->done += nca.size;
+    }
+
+    log_write("nca lane returned now\n");
+}
+
+Result Yati::InstallNcas(std::span<TikCollection> tickets, std::span<NcaCollection> ncas) {
+    // ncz's use their own block / ctr worker pools and a larger inflate
+    // buffer, so they are installed one at a time, as are installs where
+    // memory is tight.
+    const auto has_ncz = std::ranges::any_of(ncas, [](auto& e){
+        return e.name.ends_with(".ncz");
+    });
+
+    if (ncas.size() <= 1 || !source->IsConcurrent() || has_ncz || App::IsApplet() || App::IsFileBaseEmummc()) {
+        for (auto& nca : ncas) {
+            R_TRY(InstallNca(tickets, nca));
         }
+        R_SUCCEED();
+    }
+
+    // installing several nca's at once avoids the pipeline draining at the
+    // end of each nca, which adds up for titles with lots of small nca's.
+    const auto count = std::min<u32>(NCA_INSTALL_LANES, ncas.size());
+    log_write("installing %zu nca's with %u lanes\n", ncas.size(), count);
+
+    nca_lanes = count;
+    ON_SCOPE_EXIT(nca_lanes = 1);
+
+    s64 total_size{};
+    for (const auto& nca : ncas) {
+        total_size += nca.size;
+    }
+
+    NcaLanes lanes{};
+    lanes.yati = this;
+    lanes.tickets = tickets;
+    lanes.ncas = ncas;
+
+    u32 started{};
+    ON_SCOPE_EXIT(
+        // stop the lanes from starting another nca if we exit early.
+        lanes.cancel = started != count;
+        for (u32 i = 0; i < started; i++) {
+            threadWaitForExit(&lanes.lanes[i].thread);
+            threadClose(&lanes.lanes[i].thread);
+        }
+    );
+
+    for (u32 i = 0; i < count; i++) {
+        auto& lane = lanes.lanes[i];
+        lane.parent = &lanes;
+
+        R_TRY(threadCreate(&lane.thread, ncaLaneFunc, &lane, nullptr, 1024*64, PRIO_PREEMPTIVE, -2));
+        if (auto rc = threadStart(&lane.thread); R_FAILED(rc)) {
+            threadClose(&lane.thread);
+            return rc;
+        }
+        started++;
+    }
+
+    pbox->NewTransfer("Installing "_i18n + std::to_string(ncas.size()) + " nca's");
+
+    // report the progress of all nca's combined, until all lanes have exited.
+    for (;;) {
+        s64 offset = lanes.done;
+        for (u32 i = 0; i < count; i++) {
+            offset += lanes.lanes[i].progress;
+        }
+        pbox->UpdateTransfer(offset, total_size);
+
+        bool running{};
+        for (u32 i = 0; i < count; i++) {
+            running |= R_FAILED(waitSingleHandle(lanes.lanes[i].thread.handle, 0));
+        }
+
+        if (!running) {
+            break;
+        }
+
+        svcSleepThread(1e+6);
+    }
+
+    R_TRY(pbox->ShouldExitResult());
+    for (u32 i = 0; i < count; i++) {
+        R_TRY(lanes.lanes[i].result);
+    }
+
+    for (const auto& nca : ncas) {
+        R_TRY(ShowNcaInfo(nca));
     }
 
     R_SUCCEED();
@@ -1081,18 +1634,9 @@ Result Yati::GetLatestVersion(const CnmtCollection& cnmt, u32& version_out, bool
     const auto app_id = ncm::GetAppId(cnmt.key);
     version_out = cnmt.key.version;
 
-    for (auto& db : ncm_db) {
-        s32 db_list_total;
-        s32 db_list_count;
-        std::vector<NcmContentMetaKey> keys(1);
-        if (R_SUCCEEDED(ncmContentMetaDatabaseList(std::addressof(db), std::addressof(db_list_total), std::addressof(db_list_count), keys.data(), keys.size(), NcmContentMetaType_Unknown, app_id, 0, UINT64_MAX, NcmContentInstallType_Full))) {
-            if (db_list_total != keys.size()) {
-                keys.resize(db_list_total);
-                if (keys.size()) {
-                    R_TRY(ncmContentMetaDatabaseList(std::addressof(db), std::addressof(db_list_total), std::addressof(db_list_count), keys.data(), keys.size(), NcmContentMetaType_Unknown, app_id, 0, UINT64_MAX, NcmContentInstallType_Full));
-                }
-            }
-
+    for (size_t i = 0; i < std::size(NCM_STORAGE_IDS); i++) {
+        std::vector<NcmContentMetaKey> keys;
+        if (R_SUCCEEDED(meta_cache->GetKeys(std::addressof(ncm_db[i]), i, app_id, keys))) {
             for (auto& key : keys) {
                 log_write("found record: %016lX type: %u version: %u\n", key.id, key.type, key.version);
 
@@ -1120,7 +1664,7 @@ Result Yati::GetLatestVersion(const CnmtCollection& cnmt, u32& version_out, bool
 Result Yati::ShouldSkip(const CnmtCollection& cnmt, bool& skip) {
     if (!skip && config.skip_if_already_installed) {
         bool has;
-        R_TRY(ncmContentMetaDatabaseHas(std::addressof(db), std::addressof(has), std::addressof(cnmt.key)));
+        R_TRY(meta_cache->Has(std::addressof(db), config.sd_card_install, cnmt.key, has));
         if (has) {
             log_write("\tskipping: [ncmContentMetaDatabaseHas()]\n");
             skip = true;
@@ -1176,8 +1720,6 @@ Result Yati::RemoveInstalledNcas(const CnmtCollection& cnmt) {
     const auto app_id = ncm::GetAppId(cnmt.key);
 
     // remove current entries (if any).
-    s32 db_list_total;
-    s32 db_list_count;
     u64 id_min = cnmt.key.id;
     u64 id_max = cnmt.key.id;
 
@@ -1192,15 +1734,12 @@ Result Yati::RemoveInstalledNcas(const CnmtCollection& cnmt) {
         auto& cs = ncm_cs[i];
         auto& db = ncm_db[i];
 
-        std::vector<NcmContentMetaKey> keys(1);
-        R_TRY(ncmContentMetaDatabaseList(std::addressof(db), std::addressof(db_list_total), std::addressof(db_list_count), keys.data(), keys.size(), static_cast<NcmContentMetaType>(cnmt.key.type), app_id, id_min, id_max, NcmContentInstallType_Full));
+        std::vector<NcmContentMetaKey> keys;
+        R_TRY(meta_cache->GetKeys(std::addressof(db), i, app_id, keys));
 
-        if (db_list_total != keys.size()) {
-            keys.resize(db_list_total);
-            if (keys.size()) {
-                R_TRY(ncmContentMetaDatabaseList(std::addressof(db), std::addressof(db_list_total), std::addressof(db_list_count), keys.data(), keys.size(), static_cast<NcmContentMetaType>(cnmt.key.type), app_id, id_min, id_max, NcmContentInstallType_Full));
-            }
-        }
+        std::erase_if(keys, [&cnmt, id_min, id_max](auto& e){
+            return e.type != cnmt.key.type || e.id < id_min || e.id > id_max;
+        });
 
         for (const auto& key : keys) {
             log_write("found key: 0x%016lX type: %u version: %u\n", key.id, key.type, key.version);
@@ -1232,6 +1771,7 @@ Result Yati::RemoveInstalledNcas(const CnmtCollection& cnmt) {
 
             log_write("trying to remove it\n");
             R_TRY(ncmContentMetaDatabaseRemove(std::addressof(db), std::addressof(key)));
+            meta_cache->Remove(i, key);
             R_TRY(ncmContentMetaDatabaseCommit(std::addressof(db)));
             log_write("all done with this key\n\n");
         }
@@ -1273,6 +1813,7 @@ Result Yati::RegisterNcasAndPushRecord(const CnmtCollection& cnmt, u32 latest_ve
 
     pbox->NewTransfer("Updating ncm database"_i18n);
     R_TRY(ncmContentMetaDatabaseSet(std::addressof(db), std::addressof(cnmt.key), buf.buf.data(), buf.tell()));
+    meta_cache->Add(config.sd_card_install, cnmt.key);
     R_TRY(ncmContentMetaDatabaseCommit(std::addressof(db)));
 
     // push record.
@@ -1330,9 +1871,7 @@ Result InstallInternal(ui::ProgressBox* pbox, source::Base* source, const contai
         }
 
         log_write("installing nca's\n");
-        for (auto& nca : cnmt.ncas) {
-            R_TRY(yati->InstallNca(tickets, nca));
-        }
+        R_TRY(yati->InstallNcas(tickets, cnmt.ncas));
 
         R_TRY(yati->ImportTickets(tickets));
         R_TRY(yati->RemoveInstalledNcas(cnmt));
@@ -1343,14 +1882,74 @@ Result InstallInternal(ui::ProgressBox* pbox, source::Base* source, const contai
     R_SUCCEED();
 }
 
+// wraps a stream, reads of entries that were spilled are served from memory.
+// this allows for entries to be installed out of order without seeking
+// backwards in the stream.
+struct SpillSource final : source::Base {
+    SpillSource(source::Base* source) : m_source{source} {
+        m_open_result = m_source->GetOpenResult();
+    }
+
+    Result Read(void* buf, s64 off, s64 size, u64* bytes_read) override {
+        for (const auto& e : m_entries) {
+            if (off >= e.offset && off < e.offset + (s64)e.data.size()) {
+                size = std::min<s64>(size, e.offset + e.data.size() - off);
+                std::memcpy(buf, e.data.data() + (off - e.offset), size);
+                *bytes_read = size;
+                R_SUCCEED();
+            }
+        }
+
+        return m_source->Read(buf, off, size, bytes_read);
+    }
+
+    bool IsStream() const override {
+        return true;
+    }
+
+    void SignalCancel() override {
+        m_source->SignalCancel();
+    }
+
+    void SetReadAheadRange(s64 off, s64 size) override {
+        m_source->SetReadAheadRange(off, size);
+    }
+
+    // reads the entry from the stream into memory.
+    Result Spill(s64 off, s64 size) {
+        auto& entry = m_entries.emplace_back(Entry{off});
+        entry.data.resize(size);
+
+        u64 bytes_read;
+        R_TRY(m_source->Read(entry.data.data(), off, size, &bytes_read));
+        R_UNLESS(bytes_read == (u64)size, Result_YatiInvalidNcaReadSize);
+        R_SUCCEED();
+    }
+
+    // frees the entry once it has been installed.
+    void Drop(s64 off) {
+        std::erase_if(m_entries, [off](auto& e){
+            return e.offset == off;
+        });
+    }
+
+private:
+    struct Entry {
+        s64 offset{};
+        std::vector<u8> data{};
+    };
+
+    source::Base* m_source{};
+    std::vector<Entry> m_entries{};
+};
+
 Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, container::Collections collections, const ConfigOverride& override) {
-    auto yati = std::make_unique<Yati>(pbox, source);
+    SpillSource spill{source};
+    auto yati = std::make_unique<Yati>(pbox, &spill);
     R_TRY(yati->Setup(override));
 
     // not supported with stream installs (yet).
     yati->config.skip_if_already_installed = false;
-    yati->config.convert_to_standard_crypto = false;
-    yati->config.lower_master_key = false;
 
     std::vector<NcaCollection> ncas{};
     std::vector<CnmtCollection> cnmts{};
@@ -1376,15 +1975,65 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
 
     std::ranges::sort(collections, sorter);
 
+    // number of tickets / certs that have yet to be read from the stream.
+    auto tickets_pending = std::ranges::count_if(collections, [](auto& e) {
+        return e.name.ends_with(".tik") || e.name.ends_with(".cert");
+    });
+
+    // converting modifies the nca header using the ticket, so every nca that
+    // comes before the last ticket has to be spilled until it's read.
+    // if they don't all fit, conversion is disabled for the whole install,
+    // rather than leaving a title that's only partly converted.
+    const auto needs_ticket = yati->config.convert_to_standard_crypto || yati->config.lower_master_key;
+    if (needs_ticket && tickets_pending) {
+        s64 last_ticket_offset{};
+        for (const auto& collection : collections) {
+            if (collection.name.ends_with(".tik") || collection.name.ends_with(".cert")) {
+                last_ticket_offset = std::max(last_ticket_offset, collection.offset);
+            }
+        }
+
+        s64 total_size{};
+        bool fits = true;
+        for (const auto& collection : collections) {
+            if (collection.offset < last_ticket_offset && (collection.name.ends_with(".nca") || collection.name.ends_with(".ncz"))) {
+                total_size += collection.size;
+                fits &= collection.size <= STREAM_SPILL_MAX_SIZE;
+            }
+        }
+
+        if (!fits || total_size > STREAM_SPILL_BUDGET) {
+            log_write("[yati] tickets come after large nca's, disabling standard crypto / lower master key\n");
+            yati->config.convert_to_standard_crypto = false;
+            yati->config.lower_master_key = false;
+        }
+    }
+
+    const auto install_nca = [&](const container::CollectionEntry& collection) -> Result {
+        auto& nca = ncas.emplace_back(NcaCollection{collection});
+        if (collection.name.ends_with(".cnmt.nca") || collection.name.ends_with(".cnmt.ncz")) {
+            auto& cnmt = cnmts.emplace_back(nca);
+            cnmt.type = NcmContentType_Meta;
+            R_TRY(yati->InstallCnmtNca(tickets, cnmt, collections));
+        } else {
+            R_TRY(yati->InstallNca(tickets, nca));
+        }
+
+        R_SUCCEED();
+    };
+
+    // spilled entries, installed once all tickets have been read.
+    std::vector<container::CollectionEntry> deferred{};
+
     for (const auto& collection : collections) {
         if (collection.name.ends_with(".nca") || collection.name.ends_with(".ncz")) {
-            auto& nca = ncas.emplace_back(NcaCollection{collection});
-            if (collection.name.ends_with(".cnmt.nca") || collection.name.ends_with(".cnmt.ncz")) {
-                auto& cnmt = cnmts.emplace_back(nca);
-                cnmt.type = NcmContentType_Meta;
-                R_TRY(yati->InstallCnmtNca(tickets, cnmt, collections));
+            // only spilled if the ticket is needed to convert the nca, checked above.
+            if (tickets_pending && (yati->config.convert_to_standard_crypto || yati->config.lower_master_key)) {
+                log_write("[yati] spilling %s until tickets are read\n", collection.name.c_str());
+                R_TRY(spill.Spill(collection.offset, collection.size));
+                deferred.emplace_back(collection);
             } else {
-                R_TRY(yati->InstallNca(tickets, nca));
+                R_TRY(install_nca(collection));
             }
         } else if (collection.name.ends_with(".tik") || collection.name.ends_with(".cert")) {
             FsRightsId rights_id{};
@@ -1404,9 +2053,16 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
             } else {
                 R_TRY(source->Read(entry->cert.data(), collection.offset, entry->cert.size(), &bytes_read));
             }
+
+            tickets_pending--;
         }
     }
 
+    for (const auto& collection : deferred) {
+        R_TRY(install_nca(collection));
+        spill.Drop(collection.offset);
+    }
+
     for (auto& cnmt : cnmts) {
         // copy nca structs into cnmt.
         for (auto& cnmt_nca : cnmt.ncas) {
@@ -1441,6 +2097,20 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
 
 } // namespace
 
+Session::Session() {
+    SCOPED_MUTEX(std::addressof(g_meta_cache_mutex));
+    if (!g_session_count++) {
+        g_meta_cache = std::make_unique<MetaCache>();
+    }
+}
+
+Session::~Session() {
+    SCOPED_MUTEX(std::addressof(g_meta_cache_mutex));
+    if (!--g_session_count) {
+        g_meta_cache.reset();
+    }
+}
+
 Result InstallFromFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, const ConfigOverride& override) {
     auto source = std::make_unique<source::File>(fs, path);
     // auto source = std::make_unique<source::StreamFile>(fs, path); // enable for testing.
@@ -23,31 +23,210 @@
 # 5. Plug in your Switch and go to Tinfoil > Title Management > USB Install NSP
 # 6. Run this script
 #      python3 usb_install_pc.py <path/to/nsp_folder>
-
-import usb.core
-import usb.util
+#
+# Optional flags:
+#   --stats     log the latency of every request and the sustained MB/s.
+#   --loopback  test the protocol against a fake device over a pipe, no switch needed.
+#      python3 usb_install_pc.py --loopback --stats <path/to/nsp_folder>
+
+import argparse
+import hashlib
+import os
+import queue
 import struct
 import sys
+import threading
 from pathlib import Path
 import time
 
 CMD_ID_EXIT = 0
 CMD_ID_FILE_RANGE = 1
 
+CMD_TYPE_REQUEST = 0
 CMD_TYPE_RESPONSE = 1
 
 # list of supported extensions.
 EXTS = (".nsp", ".xci", ".nsz", ".xcz")
 
+# size of each read from disk / write to usb.
+CHUNK_SIZE = 0x100000
+# number of chunks the reader thread may read ahead of usb.
+READ_AHEAD_CHUNKS = 32
+
+class FileReader:
+    """Reads files on a background thread so that disk reads overlap usb writes.
+
+    The reader keeps reading past the end of the requested range, as the switch
+    reads files sequentially, so the next request is usually already in memory.
+    A request for any other offset restarts the reader from that offset.
+    """
+
+    def __init__(self, chunk_size=CHUNK_SIZE, read_ahead_chunks=READ_AHEAD_CHUNKS):
+        self.chunk_size = chunk_size
+        self.queue = queue.Queue(max(1, read_ahead_chunks))
+        self.cond = threading.Condition()
+        self.gen = 0
+        self.path = None
+        self.pos = 0
+        self.next_path = None
+        self.next_off = None
+        self.leftover = memoryview(b'')
+        threading.Thread(target=self._worker, daemon=True).start()
+
+    def _restart(self, path, off):
+        with self.cond:
+            self.gen += 1
+            self.path = path
+            self.pos = off
+            self.cond.notify()
+
+        # anything still queued is from the previous position.
+        while True:
+            try:
+                self.queue.get_nowait()
+            except queue.Empty:
+                break
+
+        self.leftover = memoryview(b'')
+
+    def _put(self, gen, data):
+        # returns False if the reader was restarted whilst waiting for space.
+        while True:
+            with self.cond:
+                if self.gen != gen:
+                    return False
+            try:
+                self.queue.put((gen, data), timeout=0.1)
+                return True
+            except queue.Full:
+                pass
+
+    def _worker(self):
+        f = None
+        f_path = None
+
+        while True:
+            with self.cond:
+                while self.path is None:
+                    self.cond.wait()
+                gen, path, pos = self.gen, self.path, self.pos
+
+            try:
+                if path != f_path:
+                    if f:
+                        f.close()
+                    f = open(path, 'rb')
+                    f_path = path
+                f.seek(pos)
+
+                while True:
+                    data = f.read(self.chunk_size)
+                    if not self._put(gen, data) or not data:
+                        break
+            except OSError as e:
+                f, f_path = None, None
+                self._put(gen, e)
+
+            # wait to be restarted, either at eof or after an error.
+            with self.cond:
+                while self.gen == gen:
+                    self.cond.wait()
+
+    def read(self, path, off, size):
+        """Yields the data for the range in chunks."""
+        if path != self.next_path or off != self.next_off:
+            self._restart(path, off)
+
+        self.next_path = path
+        self.next_off = None
+        end = off + size
+
+        while size:
+            if not self.leftover:
+                gen, data = self.queue.get()
+                if gen != self.gen:
+                    continue
+                if isinstance(data, Exception):
+                    raise data
+                if not data:
+                    raise EOFError('range is past the end of {}'.format(path))
+                self.leftover = memoryview(data)
+
+            buf = self.leftover[:size]
+            self.leftover = self.leftover[len(buf):]
+            size -= len(buf)
+            yield buf
+
+        self.next_off = end
+
+class Stats:
+    """Tracks per request latency and sustained throughput."""
+
+    def __init__(self, enabled):
+        self.enabled = enabled
+        self.start = time.perf_counter()
+        self.total_bytes = 0
+        self.requests = 0
+        self.latencies = []
+        self.last_report = self.start
+        self.last_bytes = 0
+
+    def add(self, size, latency):
+        if not self.enabled:
+            return
+
+        self.total_bytes += size
+        self.requests += 1
+        self.latencies.append(latency)
+
+        now = time.perf_counter()
+        if now - self.last_report >= 1.0:
+            mbs = (self.total_bytes - self.last_bytes) / (now - self.last_report) / 0x100000
+            print('[stats] {:.2f} MB/s, {} requests'.format(mbs, self.requests), flush=True)
+            self.last_report = now
+            self.last_bytes = self.total_bytes
+
+    def summary(self):
+        if not self.enabled or not self.requests:
+            return
+
+        elapsed = time.perf_counter() - self.start
+        lat = sorted(self.latencies)
+        print('[stats] sent {:.2f} MiB in {:.2f}s, {:.2f} MB/s average'.format(
+            self.total_bytes / 0x100000, elapsed, self.total_bytes / elapsed / 0x100000))
+        print('[stats] request latency ms: min {:.2f} median {:.2f} p99 {:.2f} max {:.2f}'.format(
+            lat[0] * 1000, lat[len(lat) // 2] * 1000, lat[min(len(lat) - 1, len(lat) * 99 // 100)] * 1000, lat[-1] * 1000))
+
+class PipeEndpoint:
+    """Pipe with the same read / write api as a pyusb endpoint."""
+
+    def __init__(self, fd):
+        self.fd = fd
+
+    def read(self, size, timeout=None):
+        buf = bytearray()
+        while len(buf) < size:
+            data = os.read(self.fd, size - len(buf))
+            if not data:
+                raise EOFError('pipe closed')
+            buf += data
+        return buf
+
+    def write(self, data, timeout=None):
+        view = memoryview(data)
+        while view:
+            view = view[os.write(self.fd, view):]
+        return len(data)
+
+def make_cmd_header(cmd_type, cmd_id, data_size):
+    # Tinfoil USB Command 0
+    return b'TUC0' + struct.pack('<B3xIQ12x', cmd_type, cmd_id, data_size)
+
 def send_response_header(out_ep, cmd_id, data_size):
-    out_ep.write(b'TUC0') # Tinfoil USB Command 0
-    out_ep.write(struct.pack('<B', CMD_TYPE_RESPONSE))
-    out_ep.write(b'\x00' * 3)
-    out_ep.write(struct.pack('<I', cmd_id))
-    out_ep.write(struct.pack('<Q', data_size))
-    out_ep.write(b'\x00' * 0xC)
-
-def file_range_cmd(nsp_dir, in_ep, out_ep, data_size):
+    out_ep.write(make_cmd_header(CMD_TYPE_RESPONSE, cmd_id, data_size))
+
+def file_range_cmd(nsp_dir, in_ep, out_ep, data_size, reader, stats):
+    start = time.perf_counter()
     file_range_header = in_ep.read(0x20)
 
     range_size = struct.unpack('<Q', file_range_header[:8])[0]
@@ -56,29 +235,21 @@ def file_range_cmd(nsp_dir, in_ep, out_ep, data_size):
     #in_ep.read(0x8) # Reserved
     nsp_name = bytes(in_ep.read(nsp_name_len)).decode('utf-8')
 
-    print('Range Size: {}, Range Offset: {}, Name len: {}, Name: {}'.format(range_size, range_offset, nsp_name_len, nsp_name))
+    if not stats.enabled:
+        print('Range Size: {}, Range Offset: {}, Name len: {}, Name: {}'.format(range_size, range_offset, nsp_name_len, nsp_name))
     send_response_header(out_ep, CMD_ID_FILE_RANGE, range_size)
 
-    with open(nsp_name, 'rb') as f:
-        f.seek(range_offset)
-
-        curr_off = 0x0
-        end_off = range_size
-        read_size = 0x800000
+    for buf in reader.read(nsp_name, range_offset, range_size):
+        out_ep.write(data=buf, timeout=0)
 
-        while curr_off < end_off:
-            if curr_off + read_size >= end_off:
-                read_size = end_off - curr_off
+    stats.add(range_size, time.perf_counter() - start)
 
-            buf = f.read(read_size)
-            out_ep.write(data=buf, timeout=0)
-            curr_off += read_size
-
-def poll_commands(nsp_dir, in_ep, out_ep):
+def poll_commands(nsp_dir, in_ep, out_ep, reader, stats):
     while True:
         cmd_header = bytes(in_ep.read(0x20, timeout=0))
         magic = cmd_header[:4]
-        print('Magic: {}'.format(magic), flush=True)
+        if not stats.enabled:
+            print('Magic: {}'.format(magic), flush=True)
 
         if magic != b'TUC0': # Tinfoil USB Command 0
             continue
@@ -87,52 +258,102 @@ def poll_commands(nsp_dir, in_ep, out_ep):
         cmd_id = struct.unpack('<I', cmd_header[8:12])[0]
         data_size = struct.unpack('<Q', cmd_header[12:20])[0]
 
-        print('Cmd Type: {}, Command id: {}, Data size: {}'.format(cmd_type, cmd_id, data_size), flush=True)
+        if not stats.enabled:
+            print('Cmd Type: {}, Command id: {}, Data size: {}'.format(cmd_type, cmd_id, data_size), flush=True)
 
         if cmd_id == CMD_ID_EXIT:
             print('Exiting...')
             break
         elif cmd_id == CMD_ID_FILE_RANGE:
-            file_range_cmd(nsp_dir, in_ep, out_ep, data_size)
+            file_range_cmd(nsp_dir, in_ep, out_ep, data_size, reader, stats)
+
+def get_nsp_list(nsp_dir):
+    # Add all files with the extension .nsp in the provided dir
+    return [f for f in nsp_dir.iterdir() if f.is_file() and (f.suffix in EXTS)]
 
 def send_nsp_list(nsp_dir, out_ep):
     nsp_path_list = list()
     nsp_path_list_len = 0
 
-    # Add all files with the extension .nsp in the provided dir
-    for nsp_path in [f for f in nsp_dir.iterdir() if f.is_file() and (f.suffix in EXTS)]:
+    for nsp_path in get_nsp_list(nsp_dir):
         nsp_path = bytes(nsp_path.__str__(), 'utf8') + b'\n'
         nsp_path_list.append(nsp_path)
         nsp_path_list_len += len(nsp_path)
 
     print('Sending header...')
 
-    out_ep.write(b'TUL0') # Tinfoil USB List 0
-    out_ep.write(struct.pack('<I', nsp_path_list_len))
-    out_ep.write(b'\x00' * 0x8) # Padding
+    # Tinfoil USB List 0
+    out_ep.write(b'TUL0' + struct.pack('<I', nsp_path_list_len) + b'\x00' * 0x8)
 
     print('Sending NSP list: {}'.format(nsp_path_list))
+    out_ep.write(b''.join(nsp_path_list))
+
+def fake_device(in_ep, out_ep, range_size):
+    """Acts as the switch, requests every file in sequential ranges and verifies the data."""
+    header = in_ep.read(0x10)
+    assert header[:4] == b'TUL0', 'bad list magic'
+    list_size = struct.unpack('<I', header[4:8])[0]
+    names = [n for n in bytes(in_ep.read(list_size)).decode('utf-8').split('\n') if n]
+
+    for name in names:
+        size = os.path.getsize(name)
+        host_hash = hashlib.sha256()
+        print('[loopback] requesting {} ({} bytes)'.format(name, size), flush=True)
+
+        off = 0
+        while off < size:
+            read_size = min(range_size, size - off)
+            name_bytes = name.encode('utf-8')
+            out_ep.write(make_cmd_header(CMD_TYPE_REQUEST, CMD_ID_FILE_RANGE, 0x20 + len(name_bytes)))
+            out_ep.write(struct.pack('<QQQQ', read_size, off, len(name_bytes), 0) + name_bytes)
+
+            response = bytes(in_ep.read(0x20))
+            assert response[:4] == b'TUC0', 'bad response magic'
+            host_hash.update(in_ep.read(read_size))
+            off += read_size
+
+        with open(name, 'rb') as f:
+            file_hash = hashlib.sha256()
+            while data := f.read(CHUNK_SIZE):
+                file_hash.update(data)
+
+        if host_hash.digest() != file_hash.digest():
+            raise RuntimeError('[loopback] data mismatch for {}'.format(name))
+        print('[loopback] verified {}'.format(name), flush=True)
+
+    out_ep.write(make_cmd_header(CMD_TYPE_REQUEST, CMD_ID_EXIT, 0))
+
+def run_loopback(nsp_dir, reader, stats, range_size):
+    # host -> device and device -> host pipes.
+    host_to_dev = os.pipe()
+    dev_to_host = os.pipe()
+    in_ep, out_ep = PipeEndpoint(dev_to_host[0]), PipeEndpoint(host_to_dev[1])
+    dev_in_ep, dev_out_ep = PipeEndpoint(host_to_dev[0]), PipeEndpoint(dev_to_host[1])
+
+    error = []
+    def device_thread():
+        try:
+            fake_device(dev_in_ep, dev_out_ep, range_size)
+        except Exception as e:
+            error.append(e)
+            os.close(dev_to_host[1])
+
+    thread = threading.Thread(target=device_thread, daemon=True)
+    thread.start()
 
-    for nsp_path in nsp_path_list:
-        out_ep.write(nsp_path)
-
-def print_usage():
-    print("""\
-usb_install_pc.py
-
-Used for the installation of NSPs over USB.
-
-Usage: usb_install_pc.py <nsp folder>""")
-
-if __name__ == '__main__':
-    if len(sys.argv) != 2:
-        print_usage()
-        sys.exit(1)
+    send_nsp_list(nsp_dir, out_ep)
+    try:
+        poll_commands(nsp_dir, in_ep, out_ep, reader, stats)
+    except EOFError:
+        pass
+    thread.join()
 
-    nsp_dir = Path(sys.argv[1])
+    if error:
+        raise error[0]
 
-    if not nsp_dir.is_dir():
-        raise ValueError('1st argument must be a directory')
+def find_switch():
+    import usb.core
+    import usb.util
 
     print("waiting for switch...\n")
     dev = None
@@ -168,5 +389,30 @@ if __name__ == '__main__':
     print("iManufacturer: {} iProduct: {} iSerialNumber: {}".format(dev.manufacturer, dev.product, dev.serial_number))
     print("bcdUSB: {} bMaxPacketSize0: {}".format(hex(dev.bcdUSB), dev.bMaxPacketSize0))
 
-    send_nsp_list(nsp_dir, out_ep)
-    poll_commands(nsp_dir, in_ep, out_ep)
+    return in_ep, out_ep
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Used for the installation of NSPs over USB.')
+    parser.add_argument('nsp_dir', type=Path, help='folder containing the files to install')
+    parser.add_argument('--stats', action='store_true', help='log request latency and throughput')
+    parser.add_argument('--loopback', action='store_true', help='test against a fake device over a pipe')
+    parser.add_argument('--loopback-range-size', type=int, default=0x800000, help='size of each range the fake device requests')
+    parser.add_argument('--read-ahead', type=int, default=READ_AHEAD_CHUNKS * CHUNK_SIZE // 0x100000, help='MiB to read ahead of usb')
+    args = parser.parse_args()
+
+    nsp_dir = args.nsp_dir
+
+    if not nsp_dir.is_dir():
+        raise ValueError('1st argument must be a directory')
+
+    reader = FileReader(CHUNK_SIZE, args.read_ahead * 0x100000 // CHUNK_SIZE)
+    stats = Stats(args.stats)
+
+    if args.loopback:
+        run_loopback(nsp_dir, reader, stats, args.loopback_range_size)
+    else:
+        in_ep, out_ep = find_switch()
+        send_nsp_list(nsp_dir, out_ep)
+        poll_commands(nsp_dir, in_ep, out_ep, reader, stats)
+
+    stats.summary()